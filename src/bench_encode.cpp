@@ -0,0 +1,88 @@
+// CLASSIFY frame encode cost per vector: the original per-byte switch into
+// stack VLAs vs. Intellino_frame_arena (header template + memcpy payloads) vs. its
+// compile-time 64-byte encoder.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "intellino_frame.h"
+
+static const int vector_max_len = Intellino_frame_arena::vector_max_len;
+
+// the encoder classify_multi used before the frame arena
+static void __attribute__((noinline)) legacy_encode (int multi_dataset_num, int vector_length,
+						char test_multi_data[][vector_max_len], volatile char* sink)
+{
+	char learn_tx_buf[(vector_length+11)*multi_dataset_num];
+
+	for (int j=0; j<multi_dataset_num; j++) {
+		for (int i=0; i<vector_length+3; i++) {
+			switch(i) {
+				case 0			:	learn_tx_buf[(vector_length+11)*j+i] = CLASSIFY_COMMAND;
+								break;
+				case 1			:	learn_tx_buf[(vector_length+11)*j+i] = (uint8_t)((vector_length-1) >> 8);
+								break;
+				case 2			:	learn_tx_buf[(vector_length+11)*j+i] = (uint8_t)((vector_length-1) & 0x00FF);
+								break;
+				default			:	learn_tx_buf[(vector_length+11)*j+i] = test_multi_data[j][i-3];
+								break;
+			}
+		}
+		learn_tx_buf[(vector_length+11)*j+(vector_length+3)] = READ_DISTANCE;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+4)] = DUMMY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+5)] = DUMMY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+6)] = DUMMY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+7)] = READ_CATEGORY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+8)] = DUMMY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+9)] = DUMMY;
+		learn_tx_buf[(vector_length+11)*j+(vector_length+10)] = DUMMY;
+	}
+	*sink = learn_tx_buf[(vector_length+11)*multi_dataset_num - 1];
+}
+
+static double ns_per_vector (std::chrono::steady_clock::time_point start, long vectors)
+{
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / vectors;
+}
+
+int main(){
+	static const int batch_sizes[] = {1, 54, 1024};
+	static const long vectors_per_run = 2000000;
+	static char data[1024][vector_max_len];
+	volatile char sink = 0;
+
+	for (int j=0; j<1024; j++)
+		for (int i=0; i<vector_max_len; i++)
+			data[j][i] = (char)rand();
+
+	Intellino_frame_arena arena;
+	printf("batch, vector_len, legacy_ns_per_vector, arena_ns_per_vector, fixed_ns_per_vector\n");
+	for (size_t b=0; b<sizeof(batch_sizes)/sizeof(batch_sizes[0]); b++) {
+		int batch = batch_sizes[b];
+		long rounds = vectors_per_run / batch;
+
+		auto start = std::chrono::steady_clock::now();
+		for (long r=0; r<rounds; r++)
+			legacy_encode(batch, vector_max_len, data, &sink);
+		double legacy = ns_per_vector(start, rounds*batch);
+
+		start = std::chrono::steady_clock::now();
+		for (long r=0; r<rounds; r++) {
+			arena.encode_classify(batch, vector_max_len, data);
+			sink = arena.tx_buf()[0];
+		}
+		double pooled = ns_per_vector(start, rounds*batch);
+
+		start = std::chrono::steady_clock::now();
+		for (long r=0; r<rounds; r++) {
+			arena.encode_classify_fixed<vector_max_len>(batch, (const uint8_t*)data, vector_max_len);
+			sink = arena.tx_buf()[0];
+		}
+		double fixed = ns_per_vector(start, rounds*batch);
+
+		printf("%d, %d, %.1f, %.1f, %.1f\n", batch, vector_max_len, legacy, pooled, fixed);
+	}
+	return 0;
+}
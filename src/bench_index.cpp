@@ -0,0 +1,190 @@
+// Approximate (Intellino_index) vs. exhaustive (Intellino_knn) nearest neighbour search on
+// a learned set far beyond chip capacity.
+//   bench_index.out [-m l1|hamming] [-n learned] [-f bits] [-j threads] [-t tables,...] [-k bits,...] [-p probes,...] reference [queries]
+// Every 8th row of the reference set is held out as a query (or the queries file is used
+// instead); the other rows are learned, then learned again with -f random bits flipped per
+// copy until -n rows are learned. The exhaustive search over them gives the true nearest
+// distance of every query. Then one CSV line per index configuration (tables x bits x
+// probes): build time, ns per query, candidates ranked per query, share of queries that
+// found every bucket empty and fell back to the exhaustive scan, recall (the index found a
+// row at the true nearest distance), category agreement and speedup over the exhaustive
+// search. Both searches run on -j threads (default 1).
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "intellino_csv.h"
+#include "intellino_dataset.h"
+#include "intellino_index.h"
+#include "intellino_knn.h"
+
+static const int vector_max_len = Intellino_knn::vector_max_len;
+
+static std::vector<int> parse_list (const char* list)
+{
+	std::vector<int> values;
+	char* end;
+	for (const char* p = list; *p; p = *end ? end + 1 : end) {
+		values.push_back((int)strtol(p, &end, 10));
+		if (end == p)
+			break;
+	}
+	return values;
+}
+
+// rows of a *.bin or *.csv, zero padded to vector_max_len
+static bool load (const char* path, std::vector<char>& rows, int* vector_length)
+{
+	Intellino_dataset dataset;
+	if (dataset.open(path)) {
+		rows.assign(dataset.rows()[0], dataset.rows()[0] + (size_t)dataset.size()*vector_max_len);
+		*vector_length = dataset.vector_length();
+		return dataset.size() > 0;
+	}
+	Intellino_csv_reader reader;
+	long count = reader.read(path, [&](const char (*vectors)[vector_max_len], int n, int length, long) {
+		*vector_length = length;
+		rows.insert(rows.end(), vectors[0], vectors[0] + (size_t)n*vector_max_len);
+		return true;
+	});
+	return count > 0;
+}
+
+static void usage (const char* name)
+{
+	fprintf(stderr, "usage: %s [-m l1|hamming] [-n learned] [-f bits] [-j threads] [-t tables,...] [-k bits,...] [-p probes,...] reference [queries]\n", name);
+	exit(2);
+}
+
+int main(int argc, char* argv[]){
+	Intellino_knn::Metric metric = Intellino_knn::L1;
+	int learned = 262144;
+	int noise_bits = 16;
+	int threads = 1;
+	std::vector<int> table_counts = parse_list("4,8,12,16");
+	std::vector<int> key_bits = parse_list("12,14,16");
+	std::vector<int> probe_counts = parse_list("0,4,16");
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:f:j:t:k:p:")) != -1) {
+		switch (opt) {
+			case 'm'	:	if (strcmp(optarg, "hamming") == 0)
+							metric = Intellino_knn::HAMMING;
+						else if (strcmp(optarg, "l1") != 0)
+							usage(argv[0]);
+						break;
+			case 'n'	:	learned = atoi(optarg);
+						break;
+			case 'f'	:	noise_bits = atoi(optarg);
+						break;
+			case 'j'	:	threads = atoi(optarg);
+						break;
+			case 't'	:	table_counts = parse_list(optarg);
+						break;
+			case 'k'	:	key_bits = parse_list(optarg);
+						break;
+			case 'p'	:	probe_counts = parse_list(optarg);
+						break;
+			default		:	usage(argv[0]);
+		}
+	}
+	if (argc - optind < 1 || argc - optind > 2 || learned < 1)
+		usage(argv[0]);
+
+	std::vector<char> reference, query_storage;
+	int vector_length = 0, query_length = 0;
+	if (!load(argv[optind], reference, &vector_length)) {
+		fprintf(stderr, "can't read %s\n", argv[optind]);
+		return 1;
+	}
+	int reference_count = (int)(reference.size() / vector_max_len);
+	bool held_out = argc - optind == 1;
+	if (held_out && reference_count < 8) {
+		fprintf(stderr, "%s: %d rows, every 8th is held out as a query so at least 8 are needed\n", argv[optind], reference_count);
+		return 1;
+	}
+	if (!held_out && !load(argv[optind+1], query_storage, &query_length)) {
+		fprintf(stderr, "can't read %s\n", argv[optind+1]);
+		return 1;
+	}
+
+	// the learned set: reference rows (minus the held out ones), then noisy copies of them
+	std::vector<int> sources;
+	for (int j=0; j<reference_count; j++) {
+		if (held_out && j % 8 == 7)
+			query_storage.insert(query_storage.end(), &reference[(size_t)j*vector_max_len], &reference[(size_t)(j+1)*vector_max_len]);
+		else
+			sources.push_back(j);
+	}
+	if (held_out)
+		query_length = vector_length;
+	int query_count = (int)(query_storage.size() / vector_max_len);
+	const char (*queries)[vector_max_len] = (const char (*)[vector_max_len])query_storage.data();
+
+	std::mt19937 random(1);
+	std::vector<char> rows((size_t)learned*vector_max_len);
+	std::vector<uint8_t> categories(learned);
+	for (int j=0; j<learned; j++) {
+		int source = sources[j % sources.size()];
+		char* row = &rows[(size_t)j*vector_max_len];
+		memcpy(row, &reference[(size_t)source*vector_max_len], vector_max_len);
+		for (int b=0; j >= (int)sources.size() && b<noise_bits; b++) {
+			int bit = (int)(random() % (vector_length*8));
+			row[bit/8] ^= (char)(1 << (bit % 8));
+		}
+		categories[j] = (uint8_t)(source % 255 + 1);
+	}
+	const char (*learned_rows)[vector_max_len] = (const char (*)[vector_max_len])rows.data();
+
+	Intellino_knn exhaustive(0, metric);
+	for (int j=0; j<learned; j++)
+		exhaustive.learn(vector_length, (const uint8_t*)learned_rows[j], categories[j]);
+	std::vector<int> true_distance(query_count), true_category(query_count);
+	auto start = std::chrono::steady_clock::now();
+	exhaustive.classify_multi(query_count, query_length, queries, true_distance.data(), true_category.data(), threads);
+	double exhaustive_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("# %s: %d learned (%d bits of noise per copy), %d queries, exhaustive %s %s: %.0f ns per query\n",
+		argv[optind], learned, noise_bits, query_count, metric == Intellino_knn::HAMMING ? "hamming" : "l1",
+		exhaustive.kernel_name(), exhaustive_seconds*1e9 / query_count);
+	fflush(stdout);
+
+	printf("tables, bits, probes, build_ms, ns_per_query, candidates_per_query, exhaustive, recall, category_agreement, speedup\n");
+	std::vector<int> distance(query_count), category(query_count);
+	for (int tables : table_counts) {
+		for (int bits : key_bits) {
+			for (int probes : probe_counts) {
+				Intellino_index_config config;
+				config.metric = metric;
+				config.tables = tables;
+				config.bits = bits;
+				config.probes = probes;
+				config.threads = threads;
+				config.exact_rows = 0;
+				Intellino_index index(config);
+				index.learn_multi(learned, vector_length, learned_rows, categories.data());
+				index.build();
+
+				start = std::chrono::steady_clock::now();
+				index.classify_multi(query_count, query_length, queries, distance.data(), category.data());
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				int found = 0, agree = 0;
+				for (int j=0; j<query_count; j++) {
+					found += distance[j] == true_distance[j];
+					agree += category[j] == true_category[j];
+				}
+				Intellino_index::Stats s = index.stats();
+				printf("%d, %d, %d, %.1f, %.0f, %.1f, %.4f, %.4f, %.4f, %.1f\n", tables, bits, probes, s.build_seconds*1e3,
+					seconds*1e9 / query_count, s.candidates_per_query(), (double)s.fallbacks / s.queries, (double)found / query_count,
+					(double)agree / query_count, exhaustive_seconds / seconds);
+				fflush(stdout);
+			}
+		}
+	}
+	return 0;
+}
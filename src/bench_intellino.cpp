@@ -0,0 +1,248 @@
+// learn / learn_multi / classify / classify_multi throughput against a real chip or the emulator,
+// swept over batch size, vector length and learned-set size. One CSV line per point:
+//   op, device, learned, vector_len, batch, vectors, seconds, vectors_per_sec,
+//   bytes_per_sec, syscalls_per_vector, cpu_us_per_vector, p50_us, p99_us
+// With -t N, N producer threads then issue single classify calls through an
+// Intellino_frontend ("frontend_classify", batch = average coalesced classify_multi) with
+// a batching wait of -w µs (default 500, 0 = no wait).
+// With -c max_hz the device is first calibrated (Intellino_spi::calibrate_speed) and a
+// "# calibration" line compares 1024-vector classify_multi throughput at the configured
+// and the calibrated clock; the sweep then runs at the calibrated clock. The probe vectors
+// stay learned on the chip (calibrate_speed), so reset the board before using it for real data.
+// syscalls are bus messages (spidev ioctls, or transfer() calls on the emulator); CPU
+// is user+system time of the whole process, so the emulator's work is included.
+// On a real chip every point reopens the device, which does not clear its neurons:
+// reset the board between runs when the learned-set size matters.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+#include "intellino_cluster.h"
+#include "intellino_frontend.h"
+#include "intellino_metrics.h"
+#include "intellino_spi.h"
+
+static const int vector_max_len = Intellino_classifier::vector_max_len;
+
+static std::vector<int> parse_list (const char* list)
+{
+	std::vector<int> values;
+	char* end;
+	for (const char* p = list; *p; p = *end ? end + 1 : end) {
+		values.push_back((int)strtol(p, &end, 10));
+		if (end == p)
+			break;
+	}
+	return values;
+}
+
+static double cpu_seconds ()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+}
+
+struct Point{
+	std::chrono::steady_clock::time_point start;
+	double cpu;
+};
+
+static Point begin_point (Intellino_classifier* chip)
+{
+	chip->reset_metrics();
+	return Point{std::chrono::steady_clock::now(), cpu_seconds()};
+}
+
+static void end_point (Intellino_classifier* chip, const Point& point, Intellino_metrics::Op op, const char* device,
+			int learned, int vector_length, int batch, const char* name = NULL)
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - point.start).count();
+	double cpu = cpu_seconds() - point.cpu;
+	Intellino_metrics metrics;
+	chip->collect_metrics(metrics);
+	long vectors = (long)metrics.vectors(op);
+	const Intellino_histogram& latency = metrics.latency(op, Intellino_metrics::TOTAL);
+
+	printf("%s, %s, %d, %d, %d, %ld, %.6f, %.1f, %.1f, %.4f, %.3f, %.1f, %.1f\n",
+		name ? name : Intellino_metrics::op_name(op), device, learned, vector_length, batch, vectors, seconds,
+		vectors / seconds, metrics.bytes() / seconds, (double)metrics.messages() / vectors, cpu*1e6 / vectors,
+		latency.percentile_ns(0.5) / 1e3, latency.percentile_ns(0.99) / 1e3);
+	fflush(stdout);
+}
+
+static double classify_multi_rate (Intellino_classifier* chip, const char rows[][vector_max_len], int batch, long vectors,
+			int* distance, int* category)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (long done = 0; done < vectors; done += batch)
+		chip->classify_multi(batch, vector_max_len, rows, distance, category);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return ((vectors + batch - 1) / batch) * batch / elapsed.count();
+}
+
+// calibrates a fresh handle on device and returns the clock the sweep should use
+static uint32_t calibrate (const char* device, uint32_t max_hz, long vectors)
+{
+	Intellino_spi chip(intellino_spi_config(device));
+	uint32_t configured = chip.speed_hz();
+	Intellino_calibration calibration;
+	calibration.max_hz = max_hz;
+	uint32_t reliable = chip.calibrate_speed(calibration);
+	if (reliable == 0) {
+		printf("# calibration: no reliable clock at or above %u Hz\n", configured);
+		return configured;
+	}
+
+	const int batch = 1024;
+	std::vector<char> storage((size_t)batch*vector_max_len);
+	for (size_t i=0; i<storage.size(); i++)
+		storage[i] = (char)rand();
+	const char (*rows)[vector_max_len] = (const char (*)[vector_max_len])storage.data();
+	std::vector<int> distance(batch), category(batch);
+	chip.classify_multi(batch, vector_max_len, rows, distance.data(), category.data());    // warm-up
+	chip.set_speed_hz(configured);
+	double configured_rate = classify_multi_rate(&chip, rows, batch, vectors, distance.data(), category.data());
+	chip.set_speed_hz(reliable);
+	double reliable_rate = classify_multi_rate(&chip, rows, batch, vectors, distance.data(), category.data());
+	printf("# calibration: %u Hz -> %u Hz, classify_multi %d: %.1f -> %.1f vectors/s (%+.1f%%)\n",
+		configured, reliable, batch, configured_rate, reliable_rate, 100.0*(reliable_rate/configured_rate - 1));
+	printf("# calibration: %d probe vectors (category %d) stay learned, reset the board before training real data\n",
+		calibration.probes, calibration.probe_category);
+	return reliable;
+}
+
+static void usage (const char* name)
+{
+	fprintf(stderr, "usage: %s [-d device] [-b batches] [-l vector_lengths] [-n learned_sizes] [-v vectors_per_point] [-t threads] [-w delay_us] [-c max_hz]\n"
+			"  device    INTELLINO_DEVICE style list (default: emu)\n"
+			"  lists     comma separated, e.g. -b 1,54,1024\n", name);
+	exit(1);
+}
+
+int main(int argc, char* argv[]){
+	const char* device = "emu";
+	std::vector<int> batches = parse_list("1,16,54,256,1024,4096");
+	std::vector<int> lengths = parse_list("5,16,32,64");
+	std::vector<int> learned_sizes = parse_list("64,256,1024");
+	long vectors_per_point = 8192;
+	int producers = 0;
+	Intellino_batch_policy policy;
+	uint32_t calibrate_hz = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:b:l:n:v:t:w:c:")) != -1) {
+		switch (opt) {
+			case 'd'	:	device = optarg;
+						break;
+			case 'b'	:	batches = parse_list(optarg);
+						break;
+			case 'l'	:	lengths = parse_list(optarg);
+						break;
+			case 'n'	:	learned_sizes = parse_list(optarg);
+						break;
+			case 'v'	:	vectors_per_point = atol(optarg);
+						break;
+			case 't'	:	producers = atoi(optarg);
+						break;
+			case 'w'	:	policy.max_delay_us = atoi(optarg);
+						break;
+			case 'c'	:	calibrate_hz = (uint32_t)atol(optarg);
+						break;
+			default		:	usage(argv[0]);
+		}
+	}
+	if (vectors_per_point < 1 || (calibrate_hz && strchr(device, ',')))
+		usage(argv[0]);
+	if (calibrate_hz) {
+		// every point reopens the device; INTELLINO_SPI_HZ carries the clock over
+		std::string hz = std::to_string(calibrate(device, calibrate_hz, vectors_per_point));
+		setenv("INTELLINO_SPI_HZ", hz.c_str(), 1);
+	}
+
+	int max_batch = 1;
+	for (int batch : batches)
+		if (batch > max_batch)
+			max_batch = batch;
+	int max_learned = 1;
+	for (int learned : learned_sizes)
+		if (learned > max_learned)
+			max_learned = learned;
+
+	std::vector<char> storage((size_t)(max_batch > max_learned ? max_batch : max_learned)*vector_max_len);
+	char (*rows)[vector_max_len] = (char (*)[vector_max_len])storage.data();
+	std::vector<int> distance(max_batch), category(max_batch);
+
+	printf("op, device, learned, vector_len, batch, vectors, seconds, vectors_per_sec, bytes_per_sec, syscalls_per_vector, cpu_us_per_vector, p50_us, p99_us\n");
+	for (int vector_length : lengths) {
+		if (vector_length < 1 || vector_length > vector_max_len) {
+			fprintf(stderr, "vector length %d out of range 1..%d\n", vector_length, vector_max_len);
+			return 1;
+		}
+		for (int learned : learned_sizes) {
+			Intellino_classifier* chip = intellino_open(device);
+			srand(learned*vector_max_len + vector_length);
+			for (size_t i=0; i<storage.size(); i++)
+				storage[i] = (char)rand();
+
+			// first half one learn() per vector, second half in a single learn_multi()
+			std::vector<uint8_t> categories(learned);
+			for (int j=0; j<learned; j++)
+				categories[j] = (uint8_t)(j % 255 + 1);
+			int half = learned / 2;
+			Point point = begin_point(chip);
+			for (int j=0; j<half; j++)
+				chip->learn(vector_length, rows[j], categories[j]);
+			end_point(chip, point, Intellino_metrics::LEARN, device, learned, vector_length, 1);
+			point = begin_point(chip);
+			chip->learn_multi(learned - half, vector_length, rows + half, categories.data() + half);
+			end_point(chip, point, Intellino_metrics::LEARN_MULTI, device, learned, vector_length, learned - half);
+
+			long single = vectors_per_point < 1024 ? vectors_per_point : 1024;
+			point = begin_point(chip);
+			for (long j=0; j<single; j++)
+				chip->classify(vector_length, rows[j % max_batch], &distance[0], &category[0]);
+			end_point(chip, point, Intellino_metrics::CLASSIFY, device, learned, vector_length, 1);
+
+			for (int batch : batches) {
+				if (batch < 1)
+					continue;
+				long rounds = (vectors_per_point + batch - 1) / batch;
+				point = begin_point(chip);
+				for (long r=0; r<rounds; r++)
+					chip->classify_multi(batch, vector_length, rows, distance.data(), category.data());
+				end_point(chip, point, Intellino_metrics::CLASSIFY_MULTI, device, learned, vector_length, batch);
+			}
+
+			if (producers > 0) {
+				Intellino_frontend* front = new Intellino_frontend(chip, policy);
+				std::atomic<long> next{0};
+				auto produce = [&]() {
+					int d, c;
+					for (long j; (j = next++) < vectors_per_point; )
+						front->classify(vector_length, rows[j % max_batch], &d, &c);
+				};
+				point = begin_point(front);
+				std::vector<std::thread> threads;
+				for (int t=0; t<producers; t++)
+					threads.emplace_back(produce);
+				for (std::thread& thread : threads)
+					thread.join();
+				long coalesced = front->classify_batches() ? front->classify_requests() / front->classify_batches() : 0;
+				end_point(front, point, Intellino_metrics::CLASSIFY_MULTI, device, learned, vector_length, (int)coalesced, "frontend_classify");
+				delete front;
+			}
+			else
+				delete chip;
+		}
+	}
+	return 0;
+}
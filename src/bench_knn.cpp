@@ -0,0 +1,171 @@
+// Host engine: L1 (the chip's metric) vs. Hamming (binary descriptors) on the same data.
+//   bench_knn.out [-n learned,...] [-q queries] [-T tile_rows,...] [-j threads] [-b bits,...] train.(csv|bin) test.(csv|bin)
+// Throughput: one CSV line per (metric, learned-set size, tile size) with the kernel picked
+// for this CPU, ns per query on -j threads (default 1) and learned rows compared per second.
+// Tile 0 scans all rows per query (default: 0 and the engine's L2-sized tile).
+// Accuracy: the training vectors are learned under their row number, then classified again
+// with -b random bits flipped in each, under both metrics (bit noise is what a binary
+// descriptor suffers from). Agreement: how often the Hamming answer to a test vector has
+// the same category as the L1 answer.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "intellino_csv.h"
+#include "intellino_dataset.h"
+#include "intellino_knn.h"
+
+static const int vector_max_len = Intellino_knn::vector_max_len;
+
+static std::vector<int> parse_list (const char* list)
+{
+	std::vector<int> values;
+	char* end;
+	for (const char* p = list; *p; p = *end ? end + 1 : end) {
+		values.push_back((int)strtol(p, &end, 10));
+		if (end == p)
+			break;
+	}
+	return values;
+}
+
+// rows of a *.bin or *.csv, zero padded to vector_max_len
+static bool load (const char* path, std::vector<char>& rows, int* vector_length)
+{
+	Intellino_dataset dataset;
+	if (dataset.open(path)) {
+		rows.assign(dataset.rows()[0], dataset.rows()[0] + (size_t)dataset.size()*vector_max_len);
+		*vector_length = dataset.vector_length();
+		return dataset.size() > 0;
+	}
+	Intellino_csv_reader reader;
+	long count = reader.read(path, [&](const char (*vectors)[vector_max_len], int n, int length, long) {
+		*vector_length = length;
+		rows.insert(rows.end(), vectors[0], vectors[0] + (size_t)n*vector_max_len);
+		return true;
+	});
+	return count > 0;
+}
+
+static const char* metric_name (Intellino_knn::Metric metric)
+{
+	return metric == Intellino_knn::HAMMING ? "hamming" : "l1";
+}
+
+static void usage (const char* name)
+{
+	fprintf(stderr, "usage: %s [-n learned,...] [-q queries] [-T tile_rows,...] [-j threads] [-b bits,...] train test\n", name);
+	exit(2);
+}
+
+int main(int argc, char* argv[]){
+	std::vector<int> learned_sizes = parse_list("240,1024,4096,16384");
+	std::vector<int> noise_bits = parse_list("0,16,32,64,96,128");
+	int default_tile = Intellino_knn::default_tile_rows;
+	std::vector<int> tile_sizes = {0, default_tile};
+	int queries = 4096;
+	int threads = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:q:T:j:b:")) != -1) {
+		switch (opt) {
+			case 'n'	:	learned_sizes = parse_list(optarg);
+						break;
+			case 'q'	:	queries = atoi(optarg);
+						break;
+			case 'T'	:	tile_sizes = parse_list(optarg);
+						break;
+			case 'j'	:	threads = atoi(optarg);
+						break;
+			case 'b'	:	noise_bits = parse_list(optarg);
+						break;
+			default		:	usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || queries < 1)
+		usage(argv[0]);
+
+	std::vector<char> train, test;
+	int train_length = 0, test_length = 0;
+	if (!load(argv[optind], train, &train_length) || !load(argv[optind+1], test, &test_length)) {
+		fprintf(stderr, "can't read %s / %s\n", argv[optind], argv[optind+1]);
+		return 1;
+	}
+	const char (*train_rows)[vector_max_len] = (const char (*)[vector_max_len])train.data();
+	const char (*test_rows)[vector_max_len] = (const char (*)[vector_max_len])test.data();
+	int train_count = (int)(train.size() / vector_max_len);
+	int test_count = (int)(test.size() / vector_max_len);
+	const Intellino_knn::Metric metrics[] = {Intellino_knn::L1, Intellino_knn::HAMMING};
+
+	// learned sets larger than the training file cycle through it; queries cycle through the test set
+	std::vector<int> distance(queries), category(queries);
+	std::vector<char> query_storage((size_t)queries*vector_max_len);
+	const char (*query_rows)[vector_max_len] = (const char (*)[vector_max_len])query_storage.data();
+	for (int j=0; j<queries; j++)
+		memcpy(query_storage.data() + (size_t)j*vector_max_len, test_rows[j % test_count], vector_max_len);
+
+	printf("metric, kernel, learned, tile_rows, queries, ns_per_query, rows_per_sec\n");
+	for (Intellino_knn::Metric metric : metrics) {
+		for (int learned : learned_sizes) {
+			Intellino_knn knn(0, metric);
+			knn.reserve(learned);
+			for (int j=0; j<learned; j++)
+				knn.learn(train_length, (const uint8_t*)train_rows[j % train_count], (j % train_count + 1) & 0xFF);
+			for (int tile : tile_sizes) {
+				knn.set_tile_rows(tile);
+				knn.classify_multi(queries < 64 ? queries : 64, test_length, query_rows, distance.data(), category.data(), threads);
+				auto start = std::chrono::steady_clock::now();
+				knn.classify_multi(queries, test_length, query_rows, distance.data(), category.data(), threads);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				printf("%s, %s, %d, %d, %d, %.1f, %.0f\n", metric_name(metric), knn.kernel_name(), learned, tile, queries,
+					seconds*1e9 / queries, (double)learned*queries / seconds);
+				fflush(stdout);
+			}
+		}
+	}
+
+	Intellino_knn l1(0, Intellino_knn::L1), hamming(0, Intellino_knn::HAMMING);
+	for (int j=0; j<train_count; j++) {
+		l1.learn(train_length, (const uint8_t*)train_rows[j], j + 1);
+		hamming.learn(train_length, (const uint8_t*)train_rows[j], j + 1);
+	}
+
+	printf("# accuracy, %d training vectors classified against themselves with random bits flipped\n", train_count);
+	printf("bits_flipped, l1_accuracy, hamming_accuracy\n");
+	std::mt19937 random(1);
+	std::vector<char> noisy(train.size());
+	std::vector<int> l1_distance(train_count), l1_category(train_count);
+	for (int bits : noise_bits) {
+		memcpy(noisy.data(), train.data(), train.size());
+		for (int j=0; j<train_count; j++)
+			for (int b=0; b<bits; b++) {
+				int bit = (int)(random() % (train_length*8));
+				noisy[(size_t)j*vector_max_len + bit/8] ^= (char)(1 << (bit % 8));
+			}
+		const char (*noisy_rows)[vector_max_len] = (const char (*)[vector_max_len])noisy.data();
+		l1.classify_multi(train_count, train_length, noisy_rows, l1_distance.data(), l1_category.data());
+		hamming.classify_multi(train_count, train_length, noisy_rows, distance.data(), category.data());
+		int l1_correct = 0, hamming_correct = 0;
+		for (int j=0; j<train_count; j++) {
+			l1_correct += l1_category[j] == j + 1;
+			hamming_correct += category[j] == j + 1;
+		}
+		printf("%d, %.4f, %.4f\n", bits, (double)l1_correct / train_count, (double)hamming_correct / train_count);
+	}
+
+	std::vector<int> test_l1_distance(test_count), test_l1_category(test_count);
+	std::vector<int> test_distance(test_count), test_category(test_count);
+	l1.classify_multi(test_count, test_length, test_rows, test_l1_distance.data(), test_l1_category.data());
+	hamming.classify_multi(test_count, test_length, test_rows, test_distance.data(), test_category.data());
+	int agree = 0;
+	for (int j=0; j<test_count; j++)
+		agree += test_l1_category[j] == test_category[j];
+	printf("# agreement, %s: hamming and l1 nearest category equal for %d of %d (%.2f%%)\n",
+		argv[optind+1], agree, test_count, 100.0 * agree / test_count);
+	return 0;
+}
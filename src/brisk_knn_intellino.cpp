@@ -3,153 +3,336 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
+#include <future>
 
 #include "./intellino_spi.h"
+#include "./intellino_cluster.h"
+#include "./intellino_scheduler.h"
+#include "./intellino_snapshot.h"
+#include "./intellino_verifier.h"
+#include "./intellino_cache.h"
+#include "./intellino_index.h"
+#include "./intellino_eval.h"
+#include "./intellino_dataset.h"
+#include "./intellino_csv.h"
 
 using namespace std;
 
-Intellino_spi manager;
-char buffer[512];
-char tokenizer [] = ",\t\n\0";
+Intellino_classifier* manager;
 static const int vector_max_len =  Intellino_spi::vector_max_len;
-static const int min_vector_len =  5;
-char vector_char[vector_max_len];
+static_assert(Intellino_csv_reader::vector_max_len == vector_max_len, "CSV rows must fit classify_multi rows");
 
 static const int test_num = 54;
-static const int vectors_num = 54;
+static const int vectors_num = 1024;  // classify_multi batch, the transport splits it at spidev bufsiz
+static const int train_value_offset = 0;  // added to every CSV value, as the old (char)atoi(tok) + offset
+static const int test_value_offset = 5;
 
-int train_intellino(const char* input_train_file, int sample_num, bool debug_print){    
-    FILE *fp = fopen(input_train_file, "r");
-    if(fp == NULL){
-        return -1;
-        printf("File not found!!!\n");
+// INTELLINO_REJECT=<distance>: test_multi answers farther than this come back unknown and are skipped
+static int reject_distance = -1;
+static long tested_num = 0;
+static long rejected_num = 0;
+
+// mapped rows written with another value offset (csv2bin -o) than the CSV path reads with:
+// copies them with every value moved by delta, so both paths send the same vectors
+static const char (*shift_rows(char (*storage)[vector_max_len], const char (*rows)[vector_max_len], int count,
+                               int vector_length, int delta))[vector_max_len]{
+    if(delta == 0) return rows;
+    memcpy(storage, rows, (size_t)count*vector_max_len);
+    for(int j=0; j < count; j++)
+        for(int i=0; i < vector_length; i++) storage[j][i] = (char)(storage[j][i] + delta);
+    return storage;
+}
+
+// *.bin datasets (see csv2bin) are mapped and streamed to learn_multi, labels become categories
+static int train_intellino_binary(const Intellino_dataset& dataset, int sample_num){
+    static char storage[vectors_num][vector_max_len];
+    int rows = dataset.size();
+    if(sample_num > 0 && sample_num < rows) rows = sample_num;
+    const uint16_t* labels = dataset.labels();
+    uint8_t categories[vectors_num];
+    for(int first=0; first < rows; first += vectors_num){
+        int count = rows - first < vectors_num ? rows - first : vectors_num;
+        for(int j=0; j < count; j++) categories[j] = labels ? labels[first+j] : first+j+1;
+        manager->learn_multi(count, dataset.vector_length(), shift_rows(storage, dataset.rows() + first, count,
+                             dataset.vector_length(), train_value_offset - dataset.value_offset()), categories);
     }
-    int cat = 1;
-    while(!feof(fp)){
-        fgets(buffer, sizeof(buffer), fp);
-        char* tok_buffer = (char*)strtok(buffer, tokenizer);
-        int vector_index = 0;
-        while(tok_buffer != NULL){
-            vector_char[vector_index] = (char)atoi(tok_buffer);
-            vector_index++;
-            tok_buffer = strtok(NULL, tokenizer);            
-        }
-        if(vector_index < min_vector_len) continue;
+    return rows;
+}
 
-        manager.learn(vector_index, vector_char, cat);
+// a line the reader rejected is already on stderr with its line number
+static void report_read_error(const char* path, long error){
+    if(error == Intellino_csv_reader::read_error) perror(path);
+    else fprintf(stderr, "%s: not a descriptor CSV\n", path);
+}
 
-        if(debug_print){
-            printf("%d VECTOR : ", cat);
-            for(int i =0; i < vector_index ; i++) printf("%d, ",vector_char[i]);
-            putchar('\n');
-            putchar('\n');
-        }
+int train_intellino(const char* input_train_file, int sample_num, bool debug_print){    
+    Intellino_dataset dataset;
+    if(dataset.open(input_train_file)) return train_intellino_binary(dataset, sample_num);
 
-        for(int i =0; i < vector_max_len ; i++) vector_char[i] = 0;
+    Intellino_csv_reader reader(vectors_num);
+    reader.set_value_offset(train_value_offset);
+    reader.set_max_rows(sample_num > 0 ? sample_num : -1);
+    uint8_t categories[vectors_num];
+    long rows = reader.read(input_train_file, [&](const char (*vectors)[vector_max_len], int count, int vector_length, long first_row){
+        for(int j=0; j < count; j++) categories[j] = first_row + j + 1;
+        manager->learn_multi(count, vector_length, vectors, categories);
 
-        cat++;
-        if(sample_num > 0 && cat == sample_num + 1) break; // for dubug
+        if(debug_print){
+            for(int j=0; j < count; j++){
+                printf("%ld VECTOR : ", first_row + j + 1);
+                for(int i =0; i < vector_length ; i++) printf("%d, ",vectors[j][i]);
+                putchar('\n');
+                putchar('\n');
+            }
+        }
+        return true;
+    });
+    if(rows < 0){
+        report_read_error(input_train_file, rows);
+        return -1;
     }
-    fclose(fp);
-    return 0;
+    return rows;
 }
 
 int test_intellino(){
-    FILE *fp = fopen("../data/train_img.csv", "r");
-    if(fp == NULL){
-        return -1;
-        printf("File not found!!!\n");
-    }
-    int cat = 1;
     int ret_dist =0, ret_cat=0;
-    while(!feof(fp)){
-        fgets(buffer, sizeof(buffer), fp);
-        char* tok_buffer = (char*)strtok(buffer, tokenizer);
-        int vector_index = 0;
-        while(tok_buffer != NULL){
-            vector_char[vector_index] = (char)atoi(tok_buffer) + 10;
-            vector_index++;
-            tok_buffer = strtok(NULL, tokenizer);
-        }
-        if(vector_index < min_vector_len) continue;
+    Intellino_csv_reader reader(vectors_num);
+    reader.set_value_offset(10);
+    reader.set_max_rows(test_num - 1);
+    long rows = reader.read("../data/train_img.csv", [&](const char (*vectors)[vector_max_len], int count, int vector_length, long first_row){
+        for(int j=0; j < count; j++){
+            manager->classify(vector_length, vectors[j], &ret_dist, &ret_cat);
 
-        manager.classify(vector_index, vector_char, &ret_dist, &ret_cat);
-        
-        if(true){
             printf("VECTOR : ");
-            for(int i =0; i < vector_index ; i++) printf("%d, ",vector_char[i]);
+            for(int i =0; i < vector_length ; i++) printf("%d, ",vectors[j][i]);
             putchar('\n');
-            printf("Expected Cat : %d, Distance : %d, Category : %d\n", cat, ret_dist, ret_cat);
-        }        
+            printf("Expected Cat : %ld, Distance : %d, Category : %d\n", first_row + j + 1, ret_dist, ret_cat);
+        }
+        return true;
+    });
+    if(rows < 0){
+        report_read_error("../data/train_img.csv", rows);
+        return -1;
+    }
+    return 0;
+}
+
+// test_multi keeps pipeline_depth batches in flight: while the I/O thread has batch N on
+// the bus, the CSV reader parses batch N+1 and this thread reports the results of batch N-1.
+static const int pipeline_depth = 3;
+
+struct Test_batch{
+    char storage[vectors_num][vector_max_len];
+    const char (*vectors)[vector_max_len];      // storage, or rows of a mapped dataset
+    const uint16_t* labels;
+    uint16_t row_labels[vectors_num];           // first_cat + i, when the rows are their own labels
+    int ret_dist[vectors_num];
+    int ret_cat[vectors_num];
+    int batch_num;
+    int vector_length;
+    int first_cat;
+    Intellino_evaluation* evaluation;           // collects the answers when not null
+    future<void> done;
+};
+
+static void report_batch(Test_batch& batch, bool debug_print){
+    batch.done.get();
+    tested_num += batch.batch_num;
+    if(reject_distance >= 0)
+        for(int i=0; i < batch.batch_num ; i++) rejected_num += batch.ret_cat[i] == Intellino_classifier::unknown_category;
+    if(batch.evaluation) batch.evaluation->add_batch(batch.batch_num, batch.labels, batch.ret_dist, batch.ret_cat);
+    if(debug_print){
+        for(int i=0; i < batch.batch_num ; i++){
+            if(batch.ret_cat[i] == Intellino_classifier::unknown_category) continue;
+            int expected_cat = batch.labels ? batch.labels[i] : batch.first_cat+i;
+            if(expected_cat != batch.ret_cat[i]){
+                printf("VECTOR : ");
+                for(int j =0; j < batch.vector_length; j++) printf("%d, ",batch.vectors[i][j]);
+                putchar('\n');
+                printf("Expected Cat : %d, Distance : %d, Category : %d\n", expected_cat, batch.ret_dist[i], batch.ret_cat[i]);
+                putchar('\n');
+            }
+        }
+    }
+}
 
-        for(int i =0; i < vector_max_len ; i++) vector_char[i] = 0;
-        cat++;
+// row_labels: without labels each row expects its own category, first_cat + i, as learned by
+// train_intellino from the same file
+static void submit_batch(Test_batch& batch, const char (*vectors)[vector_max_len], const uint16_t* labels,
+                         int batch_num, int vector_length, int first_cat, Intellino_evaluation* evaluation, bool row_labels){
+    if(!labels && row_labels){
+        for(int i=0; i < batch_num; i++) batch.row_labels[i] = (uint8_t)(first_cat + i);
+        labels = batch.row_labels;
+    }
+    batch.vectors = vectors;
+    batch.labels = labels;
+    batch.batch_num = batch_num;
+    batch.vector_length = vector_length;
+    batch.first_cat = first_cat;
+    batch.evaluation = evaluation;
+    batch.done = manager->classify_multi_async(batch_num, vector_length, vectors, batch.ret_dist, batch.ret_cat, reject_distance);
+}
 
-        if(cat == test_num) break; // for dubug
+static void drain_batches(Test_batch batches[], int batch_id, bool debug_print){
+    for(int i=0; i < pipeline_depth; i++){
+        Test_batch& batch = batches[(batch_id + i) % pipeline_depth];
+        if(batch.done.valid()) report_batch(batch, debug_print);
     }
-    fclose(fp);
+}
+
+// mapped rows go to classify_multi as they are (no parsing, no copy) when they carry test_value_offset
+static int test_multi_binary(const Intellino_dataset& dataset, int sample_num, bool debug_print, Intellino_evaluation* evaluation,
+                             bool row_labels){
+    static Test_batch batches[pipeline_depth];
+    int rows = dataset.size();
+    if(sample_num > 0 && sample_num < rows) rows = sample_num;
+    const uint16_t* labels = dataset.labels();
+    int batch_id = 0;
+    for(int first = 0; first < rows; first += vectors_num){
+        int batch_num = rows - first < vectors_num ? rows - first : vectors_num;
+        Test_batch& batch = batches[batch_id];
+        const char (*vectors)[vector_max_len] = shift_rows(batch.storage, dataset.rows() + first, batch_num,
+                                                           dataset.vector_length(), test_value_offset - dataset.value_offset());
+        submit_batch(batch, vectors, labels ? labels + first : NULL, batch_num, dataset.vector_length(), first + 1, evaluation, row_labels);
+        batch_id = (batch_id + 1) % pipeline_depth;
+        if(batches[batch_id].done.valid()) report_batch(batches[batch_id], debug_print);
+    }
+    drain_batches(batches, batch_id, debug_print);
     return 0;
 }
 
-int test_multi(const char* input_test_file, int sample_num, bool debug_print){
-    FILE *fp = fopen(input_test_file, "r");
-    if(fp == NULL){
+// evaluation (optional) accumulates every answer, against the labels of a labeled *.bin or,
+// with row_labels, the row numbers train_intellino learned the same file under
+int test_multi(const char* input_test_file, int sample_num, bool debug_print, Intellino_evaluation* evaluation = NULL,
+               bool row_labels = false){
+    Intellino_dataset dataset;
+    if(dataset.open(input_test_file)) return test_multi_binary(dataset, sample_num, debug_print, evaluation, row_labels);
+
+    static Test_batch batches[pipeline_depth];
+    int batch_id = 0;
+    Intellino_csv_reader reader(vectors_num);
+    reader.set_value_offset(test_value_offset);
+    reader.set_max_rows(sample_num > 0 ? sample_num : -1);
+    long rows = reader.read(input_test_file, [&](const char (*vectors)[vector_max_len], int count, int vector_length, long first_row){
+        Test_batch& batch = batches[batch_id];
+        memcpy(batch.storage, vectors, (size_t)count*vector_max_len);
+        submit_batch(batch, batch.storage, NULL, count, vector_length, first_row + 1, evaluation, row_labels);
+        batch_id = (batch_id + 1) % pipeline_depth;
+        if(batches[batch_id].done.valid()) report_batch(batches[batch_id], debug_print);
+        return true;
+    });
+    drain_batches(batches, batch_id, debug_print);
+    if(rows < 0){
+        report_read_error(input_test_file, rows);
         return -1;
-        printf("File not found!!!\n");
-    }
-    int line_num = 1;
-    int ret_dist[vector_max_len];
-    int ret_cat[vector_max_len];
-    int vectors_id = 0;
-    char vectors[vectors_num][vector_max_len] = {0};
-    char vector_buffer[vector_max_len] = {0};
-    while(!feof(fp)){
-        fgets(buffer, sizeof(buffer), fp);
-        char* tok_buffer = (char*)strtok(buffer, tokenizer);
-        int vector_index = 0;
-        while(tok_buffer != NULL){
-            vectors[vectors_id][vector_index]  = (char)atoi(tok_buffer) + 5;
-            vector_index++;
-            tok_buffer = strtok(NULL, tokenizer);
-        }
-        if(vector_index < min_vector_len){
-            printf("[WARNING] line number %d does not have more %d elements\n", line_num, min_vector_len);
-            break;
-        }
-        
-        vectors_id++;
-        if(vectors_id == vectors_num){
-            vectors_id = 0;
-            manager.classify_multi(vectors_num, vector_index, vectors, ret_dist, ret_cat);            
-            if(debug_print){
-                for(int i=0; i < vectors_num ; i++){
-                    if(i+1 != ret_cat[i]){
-                        printf("VECTOR : ");
-                        for(int j =0; j < vector_index; j++) printf("%d, ",vectors[i][j]);
-                        putchar('\n');
-                        printf("Expected Cat : %d, Distance : %d, Category : %d\n", i+1, ret_dist[i], ret_cat[i]);
-                        putchar('\n');
-                    }
-                }
-            }
-        }
-        vector_index = 0;
-        line_num++;
-        if(sample_num > 0 && line_num >= sample_num + 1) break; // for dubug
     }
-    fclose(fp);
     return 0;
 }
 
+// the binary datasets written by `make data` skip all CSV parsing when they exist
+static const char* dataset_file(const char* csv_file, const char* bin_file){
+    return access(bin_file, R_OK) == 0 ? bin_file : csv_file;
+}
+
 int main(){
-    train_intellino("../data/train_img.csv", -1, false);
-    puts("Training is finished.");
+    manager = intellino_open(NULL);
+    // INTELLINO_DEVICE=index[:tables:bits:probes] answers from the host LSH index instead of a chip
+    Intellino_index* index = dynamic_cast<Intellino_index*>(manager);
+    // INTELLINO_HYBRID=1 lets the host answer the part of each batch the chip would queue
+    Intellino_scheduler* hybrid = NULL;
+    const char* hybrid_env = getenv("INTELLINO_HYBRID");
+    if (hybrid_env && atoi(hybrid_env))
+        manager = hybrid = new Intellino_scheduler(manager, intellino_neurons(NULL));
+
+    // INTELLINO_VERIFY=<n> checks every chip answer, recomputes one query in n on the host
+    // (0 = plausibility checks only) and retries corrupted batches
+    Intellino_verifier* verifier = NULL;
+    const char* verify_env = getenv("INTELLINO_VERIFY");
+    if (verify_env) {
+        Intellino_verify_policy policy;
+        policy.sample_every = atoi(verify_env);
+        manager = verifier = new Intellino_verifier(manager, policy, intellino_neurons(NULL));
+    }
+
+    // INTELLINO_CACHE=<n> answers repeated vectors from an LRU of n results and sends each
+    // distinct vector of a batch once
+    Intellino_cache* cache = NULL;
+    const char* cache_env = getenv("INTELLINO_CACHE");
+    if (cache_env) {
+        Intellino_cache_policy policy;
+        policy.capacity = atoi(cache_env);
+        manager = cache = new Intellino_cache(manager, policy);
+    }
+
+    // INTELLINO_SNAPSHOT=<file> restores the learned vectors from the file when it is valid,
+    // otherwise trains as usual and records every learn call into it
+    const char* snapshot_file = getenv("INTELLINO_SNAPSHOT");
+    Intellino_snapshot snapshot;
+    auto start = chrono::steady_clock::now();
+    if (snapshot_file && snapshot.load(snapshot_file)) {
+        snapshot.restore(*manager);
+        double restore_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        printf("Restored %d vectors from %s. (%.3f ms)\n", snapshot.size(), snapshot_file, restore_ms);
+    }
+    else {
+        Intellino_recorder* recorder = NULL;
+        if (snapshot_file)
+            manager = recorder = new Intellino_recorder(manager);
+        int learned = train_intellino(dataset_file("../data/train_img.csv", "../data/train_img.bin"), -1, false);
+        double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        printf("Training is finished. (%d vectors, %.3f ms per 1000)\n", learned, learned > 0 ? load_ms * 1000 / learned : 0.0);
+        if (recorder && !recorder->snapshot().save(snapshot_file))
+            printf("Can't write snapshot %s\n", snapshot_file);
+    }
 
-    for(int i=0; i < 5; i++) test_multi("../data/train_img.csv", test_num, true);
+    const char* reject_env = getenv("INTELLINO_REJECT");
+    if (reject_env) reject_distance = atoi(reject_env);
+
+    // the training rows again (test offset), each expected back under its own row number
+    Intellino_evaluation partial;
+    for(int i=0; i < 5; i++) test_multi("../data/train_img.csv", test_num, true, &partial, true);
     puts("Partial Sample Multi Testing is finished.");
+    partial.print_summary(stdout);
 
-    test_multi("../data/test_img.csv", -1, false);
-    puts("All Sample Multi Testing is finished.");
+    long partial_tested = tested_num, partial_rejected = rejected_num;
+    start = chrono::steady_clock::now();
+    Intellino_evaluation evaluation;
+    test_multi(dataset_file("../data/test_img.csv", "../data/test_img.bin"), -1, false, &evaluation);
+    double all_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("All Sample Multi Testing is finished. (%.1f ms)\n", all_ms);
+    evaluation.print_summary(stdout);
+    if (reject_distance >= 0)
+        printf("Rejected beyond distance %d: partial %ld of %ld, all %ld of %ld (%.1f%%)\n", reject_distance,
+            partial_rejected, partial_tested, rejected_num - partial_rejected, tested_num - partial_tested,
+            tested_num > partial_tested ? 100.0 * (rejected_num - partial_rejected) / (tested_num - partial_tested) : 0.0);
+    if (hybrid) {
+        hybrid->print_stats(stdout);
+        // the same pass again with the host idle; a warm result cache would skew it
+        if (!cache) {
+            hybrid->set_chip_only(true);
+            start = chrono::steady_clock::now();
+            test_multi(dataset_file("../data/test_img.csv", "../data/test_img.bin"), -1, false);
+            double chip_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            hybrid->set_chip_only(false);
+            printf("hybrid: %.1f ms, chip only %.1f ms, measured speedup %.2fx\n", all_ms, chip_ms, chip_ms / all_ms);
+        }
+    }
+    if (verifier)
+        verifier->print_stats(stdout);
+    if (cache)
+        cache->print_stats(stdout);
+    if (index)
+        index->print_stats(stdout);
+
+    // INTELLINO_METRICS=json or prometheus dumps the per-call latency / throughput numbers
+    const char* metrics_format = getenv("INTELLINO_METRICS");
+    if (metrics_format) {
+        Intellino_metrics metrics;
+        manager->collect_metrics(metrics);
+        metrics.write(stdout, strcmp(metrics_format, "prometheus") == 0 ? Intellino_metrics::PROMETHEUS : Intellino_metrics::JSON);
+    }
 
+    delete manager;
     return 0;
 }
\ No newline at end of file
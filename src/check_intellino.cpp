@@ -0,0 +1,670 @@
+// Equivalence checks of the classifiers against a brute-force reference, run by `make check`.
+//   check_intellino.out [-n learned] [-q queries] [-s seed]
+// The learned set is random rows over a narrow value range plus exact duplicates and
+// all-zero rows, so many queries hit distance ties, which must resolve to the earliest
+// learned vector everywhere. Each check prints one line; the exit status is the number of
+// failed checks.
+//   host      Intellino_knn classify / classify_multi, one thread and several
+//   emu       Intellino_spi over the emulator, classify / classify_multi
+//   async     classify_multi_async batches in flight on the I/O thread at once
+//   cluster   three emulated chips filled past their capacity; two callers and the async
+//             I/O thread on one cluster at once
+//   scheduler chip / host split over the emulator, chip only, singles racing batches
+//   topk      classify_topk on the host engine, the emulator and a cluster past capacity
+//   frontend  the shared queue alone and under four producers mixing classify and batches
+//   fixed     the std::array (compile-time length) learn / classify paths of Intellino_spi
+//   verifier  every answer recomputed on the host: none may be flagged on a clean chip,
+//             and a link that flips reply bits must still give the reference answers
+//   cache     cold, warm and in-batch duplicate answers, an LRU smaller than the batch
+//   bounds    classify_multi_within: pruned host search, empty store, chip and cluster
+//   hamming   the HAMMING host engine, and both exported distance kernels on unaligned rows
+//   index     exhaustive below exact_rows; through the tables, learned rows are found
+//             exactly and no answer is closer than the true nearest
+//   tiles     blocked host classify_multi: no blocking, odd and default tiles, rows and
+//             queries split over threads, a store reserved ahead and rows nearest_rows merges
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "intellino_cache.h"
+#include "intellino_cluster.h"
+#include "intellino_emulator.h"
+#include "intellino_frontend.h"
+#include "intellino_index.h"
+#include "intellino_knn.h"
+#include "intellino_scheduler.h"
+#include "intellino_spi.h"
+#include "intellino_verifier.h"
+
+static const int vector_max_len = Intellino_classifier::vector_max_len;
+static const int max_distance = Intellino_classifier::max_distance;
+static const int unknown_category = Intellino_classifier::unknown_category;
+
+typedef const char (*Rows)[vector_max_len];
+
+static int failed = 0;
+
+static void report (const char* name, int mismatches, int checked)
+{
+	printf("%s %-44s %d answers\n", mismatches ? "FAIL" : "ok  ", name, checked);
+	if (mismatches) {
+		printf("     %d of them differ from the reference\n", mismatches);
+		failed++;
+	}
+	fflush(stdout);
+}
+
+// -------------------
+// reference
+// -------------------
+struct Reference{
+	int vector_length;
+	std::vector<char> rows;             // learned, vector_max_len apart
+	std::vector<uint8_t> categories;
+
+	int size () const { return (int)categories.size(); }
+	Rows data () const { return (Rows)rows.data(); }
+
+	int distance (const char* query, int j) const
+	{
+		int sum = 0;
+		for (int i=0; i<vector_length; i++)
+			sum += abs((uint8_t)query[i] - (uint8_t)rows[(size_t)j*vector_max_len + i]);
+		return sum > max_distance ? max_distance : sum;
+	}
+
+	// the k nearest of the first learned rows, (distance, learn order); missing read 0xFFFF / 0
+	void topk (const char* query, int k, int learned, int* distance, int* category) const
+	{
+		std::vector<uint64_t> keys(learned);
+		for (int j=0; j<learned; j++)
+			keys[j] = ((uint64_t)this->distance(query, j) << 32) | (uint32_t)j;
+		int found = k < learned ? k : learned;
+		std::partial_sort(keys.begin(), keys.begin() + found, keys.end());
+		for (int r=0; r<k; r++) {
+			distance[r] = r < found ? (int)(keys[r] >> 32) : max_distance;
+			category[r] = r < found ? categories[(uint32_t)keys[r]] : 0;
+		}
+	}
+
+	// answers of classify_multi over the first learned rows, unknown past reject_distance
+	void nearest (Rows queries, int count, int learned, int reject_distance, std::vector<int>& distance, std::vector<int>& category) const
+	{
+		distance.resize(count);
+		category.resize(count);
+		for (int q=0; q<count; q++) {
+			topk(queries[q], 1, learned, &distance[q], &category[q]);
+			if (reject_distance >= 0 && (learned == 0 || distance[q] > reject_distance)) {
+				distance[q] = max_distance;
+				category[q] = unknown_category;
+			}
+		}
+	}
+};
+
+static Reference make_set (int vector_length, int learned, std::mt19937& random)
+{
+	Reference set;
+	set.vector_length = vector_length;
+	set.rows.assign((size_t)learned*vector_max_len, 0);
+	set.categories.resize(learned);
+	for (int j=0; j<learned; j++) {
+		char* row = &set.rows[(size_t)j*vector_max_len];
+		if (j % 13 == 5)
+			;                                               // all-zero rows
+		else if (j % 7 == 3 && j > 0)
+			memcpy(row, row - vector_max_len*(1 + j % 3), vector_length);   // duplicates
+		else
+			for (int i=0; i<vector_length; i++)
+				row[i] = (char)(random() % 24);
+		set.categories[j] = (uint8_t)(j % 250 + 1);
+	}
+	return set;
+}
+
+// learned rows (exact and shifted by one) and fresh random ones
+static std::vector<char> make_queries (const Reference& set, int count, std::mt19937& random)
+{
+	std::vector<char> queries((size_t)count*vector_max_len, 0);
+	for (int q=0; q<count; q++) {
+		char* query = &queries[(size_t)q*vector_max_len];
+		if (q % 3 == 0 && set.size() > 0)
+			memcpy(query, set.data()[random() % set.size()], set.vector_length);
+		else
+			for (int i=0; i<set.vector_length; i++)
+				query[i] = (char)(random() % 24);
+		if (q % 3 == 1)
+			query[random() % set.vector_length] += 1;
+	}
+	return queries;
+}
+
+static int differences (const std::vector<int>& distance, const std::vector<int>& category,
+				const std::vector<int>& want_distance, const std::vector<int>& want_category)
+{
+	int diff = 0;
+	for (size_t j=0; j<want_distance.size(); j++)
+		diff += distance[j] != want_distance[j] || category[j] != want_category[j];
+	return diff;
+}
+
+// -------------------
+// checks
+// -------------------
+static void check_multi (const char* name, Intellino_classifier& backend, const Reference& set, Rows queries, int count, int learned)
+{
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, learned, -1, want_distance, want_category);
+	backend.classify_multi(count, set.vector_length, queries, distance.data(), category.data());
+	report(name, differences(distance, category, want_distance, want_category), count);
+}
+
+static void check_single (const char* name, Intellino_classifier& backend, const Reference& set, Rows queries, int count, int learned)
+{
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, learned, -1, want_distance, want_category);
+	for (int q=0; q<count; q++)
+		backend.classify(set.vector_length, queries[q], &distance[q], &category[q]);
+	report(name, differences(distance, category, want_distance, want_category), count);
+}
+
+static void check_within (const char* name, Intellino_classifier& backend, const Reference& set, Rows queries, int count,
+				int learned, int reject_distance)
+{
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, learned, reject_distance, want_distance, want_category);
+	int rejected = backend.classify_multi_within(reject_distance, count, set.vector_length, queries, distance.data(), category.data());
+	int want_rejected = 0;
+	for (int c : want_category)
+		want_rejected += c == unknown_category;
+	report(name, differences(distance, category, want_distance, want_category) + (rejected != want_rejected), count);
+}
+
+static void check_topk (const char* name, Intellino_classifier& backend, const Reference& set, Rows queries, int count,
+				int learned, int k)
+{
+	std::vector<int> want_distance((size_t)count*k), want_category((size_t)count*k), distance((size_t)count*k), category((size_t)count*k);
+	for (int q=0; q<count; q++)
+		set.topk(queries[q], k, learned, &want_distance[(size_t)q*k], &want_category[(size_t)q*k]);
+	backend.classify_topk(count, set.vector_length, queries, k, distance.data(), category.data());
+	report(name, differences(distance, category, want_distance, want_category), count*k);
+}
+
+// learned through classify's own path: one learn() per row
+static void learn_host (Intellino_knn& knn, const Reference& set)
+{
+	for (int j=0; j<set.size(); j++)
+		knn.learn(set.vector_length, (const uint8_t*)set.data()[j], set.categories[j]);
+}
+
+static void check_host (const Reference& set, Rows queries, int count)
+{
+	Intellino_knn knn;
+	learn_host(knn, set);
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+
+	for (int q=0; q<count; q++)
+		knn.classify(set.vector_length, (const uint8_t*)queries[q], &distance[q], &category[q]);
+	report("host classify", differences(distance, category, want_distance, want_category), count);
+
+	for (int threads=1; threads<=3; threads+=2) {
+		knn.classify_multi(count, set.vector_length, queries, distance.data(), category.data(), threads);
+		char name[64];
+		snprintf(name, sizeof(name), "host classify_multi, %d threads", threads);
+		report(name, differences(distance, category, want_distance, want_category), count);
+	}
+}
+
+static void check_emulator (const Reference& set, Rows queries, int count)
+{
+	Intellino_spi chip(intellino_open_transport("emu"));
+	chip.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("emu classify_multi", chip, set, queries, count, set.size());
+	check_single("emu classify", chip, set, queries, count, set.size());
+}
+
+// several batches queued on the I/O thread before the first is collected
+static void check_async (const Reference& set, Rows queries, int count)
+{
+	Intellino_spi chip(intellino_open_transport("emu"));
+	chip.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	std::vector<int> want_distance, want_category;
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+
+	const int batches = 4;
+	std::vector<int> distance[batches], category[batches];
+	std::future<void> done[batches];
+	for (int b=0; b<batches; b++) {
+		distance[b].resize(count);
+		category[b].resize(count);
+		done[b] = chip.classify_multi_async(count, set.vector_length, queries, distance[b].data(), category[b].data());
+	}
+	int diff = 0;
+	for (int b=0; b<batches; b++) {
+		done[b].get();
+		diff += differences(distance[b], category[b], want_distance, want_category);
+	}
+	report("emu classify_multi_async, 4 in flight", diff, batches*count);
+}
+
+// -------------------
+// concurrency
+// -------------------
+// Callers hammer one classifier at once; every answer must still be the reference's.
+static int concurrent_mismatches (Intellino_classifier& backend, const Reference& set, Rows queries, int count, int learned,
+				int callers, int rounds, bool async, bool singles)
+{
+	std::vector<int> want_distance, want_category;
+	set.nearest(queries, count, learned, -1, want_distance, want_category);
+	std::atomic<int> diff{0};
+	auto call = [&](int caller) {
+		std::vector<int> distance(count), category(count);
+		for (int round=0; round<rounds; round++) {
+			if (singles && caller % 2 == 1) {
+				for (int q=0; q<count; q++)
+					backend.classify(set.vector_length, queries[q], &distance[q], &category[q]);
+			}
+			else if (async && caller == 0) {
+				backend.classify_multi_async(count, set.vector_length, queries, distance.data(), category.data()).get();
+			}
+			else {
+				backend.classify_multi(count, set.vector_length, queries, distance.data(), category.data());
+			}
+			diff += differences(distance, category, want_distance, want_category);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int c=1; c<callers; c++)
+		threads.emplace_back(call, c);
+	call(0);
+	for (std::thread& thread : threads)
+		thread.join();
+	return diff;
+}
+
+static void check_cluster (const Reference& set, Rows queries, int count)
+{
+	// three chips, a third of the set each minus a few: the tail is dropped as on a full chip
+	int per_chip = set.size() / 3 - 5;
+	char devices[64];
+	snprintf(devices, sizeof(devices), "emu:%d,emu:%d,emu:%d", per_chip, per_chip, per_chip);
+	Intellino_classifier* cluster = intellino_open(devices);
+	int half = set.size() / 2;
+	cluster->learn_multi(half, set.vector_length, set.data(), set.categories.data());
+	for (int j=half; j<set.size(); j++)
+		cluster->learn(set.vector_length, set.data()[j], set.categories[j]);
+	int learned = 3*per_chip;
+	check_multi("cluster classify_multi", *cluster, set, queries, count, learned);
+	check_single("cluster classify", *cluster, set, queries, count, learned);
+	delete cluster;
+
+	per_chip = (set.size() + 1) / 2;
+	snprintf(devices, sizeof(devices), "emu:%d,emu:%d", per_chip, per_chip);
+	cluster = intellino_open(devices);
+	cluster->learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	report("threads: 2 callers on a cluster", concurrent_mismatches(*cluster, set, queries, count, set.size(), 2, 20, false, false), 2*20*count);
+	report("threads: caller + async on a cluster", concurrent_mismatches(*cluster, set, queries, count, set.size(), 2, 20, true, false), 2*20*count);
+	delete cluster;
+}
+
+static void check_scheduler (const Reference& set, Rows queries, int count)
+{
+	Intellino_scheduler scheduler(new Intellino_spi(intellino_open_transport("emu")), 0, 2, 16);
+	scheduler.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("scheduler classify_multi", scheduler, set, queries, count, set.size());
+	check_single("scheduler classify", scheduler, set, queries, count, set.size());
+	scheduler.set_chip_only(true);
+	check_multi("scheduler classify_multi, chip only", scheduler, set, queries, count, set.size());
+	scheduler.set_chip_only(false);
+
+	int per_chip = (set.size() + 1) / 2;
+	char devices[64];
+	snprintf(devices, sizeof(devices), "emu:%d,emu:%d", per_chip, per_chip);
+	Intellino_scheduler shared(intellino_open(devices), set.size(), 1, 16);
+	shared.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	report("threads: scheduler singles + batches", concurrent_mismatches(shared, set, queries, count, set.size(), 2, 10, false, true), 2*10*count);
+}
+
+static void check_ranks (const Reference& set, Rows queries, int count)
+{
+	Intellino_knn knn;
+	learn_host(knn, set);
+	for (int k : {1, 3, 8}) {
+		std::vector<int> want_distance(k), want_category(k), distance(k), category(k);
+		int diff = 0;
+		for (int q=0; q<count; q++) {
+			set.topk(queries[q], k, set.size(), want_distance.data(), want_category.data());
+			knn.classify_topk(set.vector_length, (const uint8_t*)queries[q], k, distance.data(), category.data());
+			diff += differences(distance, category, want_distance, want_category);
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "host classify_topk k=%d", k);
+		report(name, diff, count*k);
+	}
+
+	Intellino_spi chip(intellino_open_transport("emu"));
+	chip.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_topk("emu classify_topk k=3", chip, set, queries, count, set.size(), 3);
+
+	// ranks past the learned count read 0xFFFF / 0 on every chip
+	int per_chip = set.size() / 3 - 5;
+	char devices[64];
+	snprintf(devices, sizeof(devices), "emu:%d,emu:%d,emu:%d", per_chip, per_chip, per_chip);
+	Intellino_classifier* cluster = intellino_open(devices);
+	cluster->learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_topk("cluster classify_topk k=4", *cluster, set, queries, count, 3*per_chip, 4);
+	delete cluster;
+	Intellino_spi small(intellino_open_transport("emu:3"), 3);
+	small.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_topk("emu classify_topk k=5 over 3 neurons", small, set, queries, count, 3, 5);
+}
+
+static void check_frontend (const Reference& set, Rows queries, int count)
+{
+	Intellino_frontend frontend(new Intellino_spi(intellino_open_transport("emu")));
+	frontend.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("frontend classify_multi", frontend, set, queries, count, set.size());
+	check_single("frontend classify", frontend, set, queries, count, set.size());
+	report("threads: 4 producers on a frontend", concurrent_mismatches(frontend, set, queries, count, set.size(), 4, 10, true, true), 4*10*count);
+}
+
+// vector lengths the frame layout is instantiated for here
+template <size_t N>
+static void check_fixed_length (const Reference& set, Rows queries, int count)
+{
+	std::vector<std::array<uint8_t, N>> rows(set.size()), tests(count);
+	for (int j=0; j<set.size(); j++)
+		memcpy(rows[j].data(), set.data()[j], N);
+	for (int q=0; q<count; q++)
+		memcpy(tests[q].data(), queries[q], N);
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+
+	Intellino_spi chip(intellino_open_transport("emu"));
+	chip.learn_multi(set.size() / 2, rows.data(), set.categories.data());
+	for (int j=set.size() / 2; j<set.size(); j++)
+		chip.learn(rows[j], set.categories[j]);
+	chip.classify_multi(count, tests.data(), distance.data(), category.data());
+	char name[64];
+	snprintf(name, sizeof(name), "emu std::array<%d> classify_multi", (int)N);
+	report(name, differences(distance, category, want_distance, want_category), count);
+	for (int q=0; q<count; q++)
+		chip.classify(tests[q], &distance[q], &category[q]);
+	snprintf(name, sizeof(name), "emu std::array<%d> classify", (int)N);
+	report(name, differences(distance, category, want_distance, want_category), count);
+}
+
+static void check_fixed (const Reference& set, Rows queries, int count)
+{
+	switch (set.vector_length) {
+		case vector_max_len	:	check_fixed_length<vector_max_len>(set, queries, count);
+						break;
+		case 37			:	check_fixed_length<37>(set, queries, count);
+						break;
+		case 8			:	check_fixed_length<8>(set, queries, count);
+						break;
+	}
+}
+
+// emulator that flips a bit of the last reply byte of every 3rd CLASSIFY frame
+struct Noisy_emulator : public Intellino_emulator{
+	long frames = 0;
+
+	void transfer (char* tx, char* rx, int len)
+	{
+		Intellino_emulator::transfer(tx, rx, len);
+		if ((uint8_t)tx[0] == CLASSIFY_COMMAND && ++frames % 3 == 0)
+			rx[len - 1] ^= (char)(1 << frames % 8);
+	}
+	void transfer_frames (char* tx, char* rx, int frame_len, int frames)
+	{
+		for (int j=0; j<frames; j++)
+			transfer(tx + (size_t)j*frame_len, rx + (size_t)j*frame_len, frame_len);
+	}
+};
+
+static void check_verifier (const Reference& set, Rows queries, int count)
+{
+	Intellino_verify_policy policy;
+	policy.sample_every = 1;
+	Intellino_verifier verifier(new Intellino_spi(intellino_open_transport("emu")), policy);
+	verifier.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("verifier classify_multi", verifier, set, queries, count, set.size());
+	check_single("verifier classify", verifier, set, queries, count, set.size());
+	check_topk("verifier classify_topk k=2", verifier, set, queries, count, set.size(), 2);
+	Intellino_verifier::Stats s = verifier.stats();
+	report("verifier: no mismatch on a clean chip", (int)(s.implausible + s.mismatched + s.fallbacks), (int)s.queries);
+
+	// a flipped category that names another row at the winning distance passes as a tie
+	Intellino_verifier repaired(new Intellino_spi(new Noisy_emulator()), policy);
+	repaired.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+	repaired.classify_multi(count, set.vector_length, queries, distance.data(), category.data());
+	int diff = 0;
+	for (int q=0; q<count; q++) {
+		bool tie = false;
+		for (int j=0; j<set.size() && !tie; j++)
+			tie = set.categories[j] == category[q] && set.distance(queries[q], j) == distance[q];
+		diff += distance[q] != want_distance[q] || !tie;
+	}
+	report("verifier classify_multi over a noisy link", diff, count);
+	s = repaired.stats();
+	report("verifier: the noisy link was caught", s.implausible + s.mismatched == 0, (int)s.queries);
+}
+
+static void check_cache (const Reference& set, Rows queries, int count)
+{
+	Intellino_cache cache(new Intellino_spi(intellino_open_transport("emu")));
+	cache.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("cache classify_multi (cold)", cache, set, queries, count, set.size());
+	check_multi("cache classify_multi (warm)", cache, set, queries, count, set.size());
+	check_single("cache classify", cache, set, queries, count, set.size());
+
+	// every query twice in one batch, through a cache that holds a fraction of them
+	std::vector<char> doubled((size_t)2*count*vector_max_len);
+	memcpy(&doubled[0], queries, (size_t)count*vector_max_len);
+	memcpy(&doubled[(size_t)count*vector_max_len], queries, (size_t)count*vector_max_len);
+	Intellino_cache_policy policy;
+	policy.capacity = count / 8;
+	Intellino_cache small(new Intellino_spi(intellino_open_transport("emu")), policy);
+	small.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("cache classify_multi, duplicates, small LRU", small, set, (Rows)doubled.data(), 2*count, set.size());
+}
+
+static void check_bounds (const Reference& set, Rows queries, int count)
+{
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+	int reject_distance = want_distance[count / 2];
+
+	Intellino_knn knn;
+	learn_host(knn, set);
+	set.nearest(queries, count, set.size(), reject_distance, want_distance, want_category);
+	knn.classify_multi(count, set.vector_length, queries, distance.data(), category.data(), 2, reject_distance);
+	report("host classify_multi within bound", differences(distance, category, want_distance, want_category), count);
+	for (int q=0; q<count; q++)
+		knn.classify(set.vector_length, (const uint8_t*)queries[q], &distance[q], &category[q], reject_distance);
+	report("host classify within bound", differences(distance, category, want_distance, want_category), count);
+
+	Intellino_knn empty;
+	empty.classify_multi(count, set.vector_length, queries, distance.data(), category.data(), 1, reject_distance);
+	set.nearest(queries, count, 0, reject_distance, want_distance, want_category);
+	report("host empty store within bound", differences(distance, category, want_distance, want_category), count);
+
+	Intellino_spi chip(intellino_open_transport("emu"));
+	chip.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_within("emu classify_multi_within", chip, set, queries, count, set.size(), reject_distance);
+
+	int per_chip = (set.size() + 1) / 2;
+	char devices[64];
+	snprintf(devices, sizeof(devices), "emu:%d,emu:%d", per_chip, per_chip);
+	Intellino_classifier* cluster = intellino_open(devices);
+	cluster->learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_within("cluster classify_multi_within", *cluster, set, queries, count, set.size(), reject_distance);
+	delete cluster;
+}
+
+static void check_hamming (const Reference& set, Rows queries, int count)
+{
+	Intellino_knn knn(0, Intellino_knn::HAMMING);
+	learn_host(knn, set);
+	std::vector<int> want_distance(count), want_category(count), distance(count), category(count);
+	for (int q=0; q<count; q++) {
+		want_distance[q] = max_distance;
+		for (int j=0; j<set.size(); j++) {
+			int bits = 0;
+			for (int i=0; i<set.vector_length; i++)
+				bits += __builtin_popcount((uint8_t)(queries[q][i] ^ set.data()[j][i]));
+			if (bits < want_distance[q]) {
+				want_distance[q] = bits;
+				want_category[q] = set.categories[j];
+			}
+		}
+	}
+	knn.classify_multi(count, set.vector_length, queries, distance.data(), category.data(), 3);
+	char name[64];
+	snprintf(name, sizeof(name), "host hamming classify_multi (%s)", knn.kernel_name());
+	report(name, differences(distance, category, want_distance, want_category), count);
+
+	// a row and a query moved off their 64-byte alignment
+	std::vector<uint8_t> unaligned(3*vector_max_len);
+	int diff = 0;
+	for (int q=0; q<count; q++) {
+		uint8_t* a = &unaligned[1 + q % 31];
+		uint8_t* b = &unaligned[vector_max_len + 33 + q % 29];
+		memcpy(a, queries[q], vector_max_len);
+		memcpy(b, set.data()[q % set.size()], vector_max_len);
+		uint32_t l1 = set.distance(queries[q], q % set.size());
+		uint32_t bits = 0;
+		for (int i=0; i<vector_max_len; i++)
+			bits += __builtin_popcount(a[i] ^ b[i]);
+		diff += intellino_l1_distance(a, b) != l1 || intellino_hamming_distance(a, b) != bits;
+	}
+	report("unaligned intellino_l1 / hamming_distance", diff, count);
+}
+
+static void check_index (const Reference& set, Rows queries, int count)
+{
+	Intellino_index index;
+	index.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	check_multi("index (exhaustive below exact_rows)", index, set, queries, count, set.size());
+
+	// approximate: a learned row hashes to its own buckets, anything else may miss its nearest
+	Intellino_index_config config;
+	config.exact_rows = 0;
+	Intellino_index hashed(config);
+	hashed.learn_multi(set.size(), set.vector_length, set.data(), set.categories.data());
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+	hashed.classify_multi(count, set.vector_length, queries, distance.data(), category.data());
+	int diff = 0;
+	for (int q=0; q<count; q++) {
+		if (want_distance[q] == 0)
+			diff += distance[q] != 0 || category[q] != want_category[q];
+		else
+			diff += distance[q] < want_distance[q];
+	}
+	report("index through the tables", diff, count);
+}
+
+static void check_tiles (const Reference& set, Rows queries, int count)
+{
+	Intellino_knn knn;
+	knn.reserve(set.size() + 7);
+	learn_host(knn, set);
+	std::vector<int> want_distance, want_category, distance(count), category(count);
+	set.nearest(queries, count, set.size(), -1, want_distance, want_category);
+
+	// unblocked, odd tiles, the default tile; query split and (tiny tiles) row split
+	const int tiles[] = {0, 7, 64, Intellino_knn::default_tile_rows};
+	for (int tile : tiles) {
+		for (int threads=1; threads<=3; threads+=2) {
+			knn.set_tile_rows(tile);
+			knn.classify_multi(count, set.vector_length, queries, distance.data(), category.data(), threads);
+			char name[64];
+			snprintf(name, sizeof(name), "host classify_multi tile %d, %d threads", tile, threads);
+			report(name, differences(distance, category, want_distance, want_category), count);
+		}
+	}
+	// fewer queries than a block, so the rows are split instead
+	std::vector<int> want_few_distance, want_few_category, few_distance(3), few_category(3);
+	set.nearest(queries, 3, set.size(), -1, want_few_distance, want_few_category);
+	knn.classify_multi(3, set.vector_length, queries, few_distance.data(), few_category.data(), 4);
+	report("host classify_multi 3 queries, 4 threads", differences(few_distance, few_category, want_few_distance, want_few_category), 3);
+
+	// two row partitions merged by the smaller distance, the lower row on ties
+	int half = set.size() / 2;
+	std::vector<uint32_t> first_distance(count, UINT32_MAX), second_distance(count, UINT32_MAX);
+	std::vector<int> first_index(count), second_index(count);
+	knn.nearest_rows(count, set.vector_length, queries, 0, half, first_distance.data(), first_index.data());
+	knn.nearest_rows(count, set.vector_length, queries, half, set.size(), second_distance.data(), second_index.data());
+	for (int q=0; q<count; q++) {
+		bool second = second_index[q] >= 0 && (first_index[q] < 0 || second_distance[q] < first_distance[q]);
+		int index = second ? second_index[q] : first_index[q];
+		distance[q] = (int)(second ? second_distance[q] : first_distance[q]);
+		category[q] = index >= 0 ? knn.category(index) : 0;
+	}
+	report("host nearest_rows, two partitions merged", differences(distance, category, want_distance, want_category), count);
+}
+
+static void usage (const char* name)
+{
+	fprintf(stderr, "usage: %s [-n learned] [-q queries] [-s seed]\n", name);
+	exit(2);
+}
+
+int main(int argc, char* argv[]){
+	int learned = 600;
+	int count = 300;
+	uint32_t seed = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:q:s:")) != -1) {
+		switch (opt) {
+			case 'n'	:	learned = atoi(optarg);
+						break;
+			case 'q'	:	count = atoi(optarg);
+						break;
+			case 's'	:	seed = (uint32_t)atoi(optarg);
+						break;
+			default		:	usage(argv[0]);
+		}
+	}
+	if (learned < 30 || count < 3)
+		usage(argv[0]);
+
+	std::mt19937 random(seed);
+	for (int vector_length : {vector_max_len, 37, 8}) {
+		printf("# %d learned, %d queries of %d bytes\n", learned, count, vector_length);
+		Reference set = make_set(vector_length, learned, random);
+		std::vector<char> storage = make_queries(set, count, random);
+		Rows queries = (Rows)storage.data();
+		check_host(set, queries, count);
+		check_emulator(set, queries, count);
+		check_async(set, queries, count);
+		check_cluster(set, queries, count);
+		check_scheduler(set, queries, count);
+		check_ranks(set, queries, count);
+		check_frontend(set, queries, count);
+		check_fixed(set, queries, count);
+		check_verifier(set, queries, count);
+		check_cache(set, queries, count);
+		check_bounds(set, queries, count);
+		check_hamming(set, queries, count);
+		check_index(set, queries, count);
+		check_tiles(set, queries, count);
+	}
+	printf("%s\n", failed ? "check: FAILED" : "check: all passed");
+	return failed;
+}
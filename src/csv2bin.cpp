@@ -0,0 +1,109 @@
+// Converts a descriptor CSV (one vector per line, comma separated 0..255 values)
+// into the binary dataset format read by Intellino_dataset.
+//   csv2bin.out [-l | -L labels.txt] [-o offset] input.csv output.bin
+//   -l : store the 1-based row number as label (the category train_intellino learns it under)
+//   -L : store the ground truth from labels.txt, one category per line in row order
+//   -o : add offset to every value (mod 256) and record it in the header
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <vector>
+
+#include "intellino_dataset.h"
+#include "intellino_csv.h"
+
+static const int vector_max_len = Intellino_dataset::vector_max_len;
+
+// one label per line; false if the file can't be read or a line is not a number
+static bool read_labels(const char* path, std::vector<uint16_t>& labels){
+    FILE* fp = fopen(path, "r");
+    if(!fp) return false;
+    char line[64];
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), fp)){
+        char* end;
+        long label = strtol(line, &end, 10);
+        ok = end != line && label >= 0 && label <= 0xFFFF;
+        labels.push_back((uint16_t)label);
+    }
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char** argv){
+    bool row_labels = false;
+    const char* labels_file = NULL;
+    int value_offset = 0;
+    std::vector<uint16_t> labels;
+    int opt;
+    while((opt = getopt(argc, argv, "lL:o:")) != -1){
+        if(opt == 'l') row_labels = true;
+        else if(opt == 'L') labels_file = optarg;
+        else if(opt == 'o') value_offset = atoi(optarg);
+        else return 2;
+    }
+    if(argc - optind != 2 || (row_labels && labels_file)){
+        fprintf(stderr, "usage: %s [-l | -L labels.txt] [-o offset] input.csv output.bin\n", argv[0]);
+        return 2;
+    }
+    if(labels_file && !read_labels(labels_file, labels)){
+        fprintf(stderr, "%s: unreadable or not one label per line\n", labels_file);
+        return 1;
+    }
+    const char* input = argv[optind];
+    const char* output = argv[optind + 1];
+
+    Intellino_dataset_writer writer;
+    int vector_length = 0;
+    bool failed = false;
+    Intellino_csv_reader reader;
+    reader.set_value_offset(value_offset);
+    long rows = reader.read(input, [&](const char (*vectors)[vector_max_len], int count, int batch_length, long first_row){
+        if(vector_length == 0){
+            vector_length = batch_length;
+            if(!writer.create(output, vector_length, row_labels || labels_file, value_offset)){
+                perror(output);
+                failed = true;
+                return false;
+            }
+        }
+        if(batch_length != vector_length){
+            fprintf(stderr, "%s: row %ld has %d values, expected %d\n", input, first_row + 1, batch_length, vector_length);
+            failed = true;
+            return false;
+        }
+        if(labels_file && first_row + count > (long)labels.size()){
+            fprintf(stderr, "%s: no label for row %ld\n", labels_file, (long)labels.size() + 1);
+            failed = true;
+            return false;
+        }
+        for(int i=0; i < count; i++){
+            uint16_t label = labels_file ? labels[first_row + i] : (uint16_t)(first_row + i + 1);
+            if(!writer.append(vectors[i], label)){
+                perror(output);
+                failed = true;
+                return false;
+            }
+        }
+        return true;
+    });
+    if(rows < 0){
+        if(rows == Intellino_csv_reader::read_error) perror(input);
+        return 1;
+    }
+    if(failed) return 1;
+
+    if(vector_length == 0){
+        fprintf(stderr, "%s: no vectors\n", input);
+        return 1;
+    }
+    if(!writer.finish()){
+        perror(output);
+        return 1;
+    }
+    printf("%s -> %s : %ld vectors of %d bytes%s, value offset %d\n", input, output, rows, vector_length,
+        labels_file ? ", labels" : row_labels ? ", row labels" : "", value_offset);
+    return 0;
+}
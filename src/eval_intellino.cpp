@@ -0,0 +1,181 @@
+// Offline evaluation: learns a training set, classifies whole test sets and reports accuracy,
+// distance percentiles and the most confused categories per test set.
+//   eval_intellino.out [-d device] [-m l1|hamming] [-t threads] [-b chunk] [-r] [-x distance] [-c confusion.csv] train test...
+// Sets are *.csv or *.bin (csv2bin); .bin values are read back without their csv2bin -o
+// offset, like a CSV. Training vectors are learned under their label (0..255, a chip
+// category), or their row number j mapped to j % 255 + 1. Test labels come from a labeled
+// *.bin (csv2bin -L), or with -r the same row mapping (for a training set classified
+// against itself); without labels only the distance distribution is reported.
+// -d host (default) runs the host engine on every core (-m hamming compares bits instead
+// of bytes); any INTELLINO_DEVICE value evaluates through intellino_open() instead.
+// -x rejects answers farther than distance as unknown (the host engine prunes its search
+// there). -c appends the confusion cells of every test set to a CSV file (created if missing).
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include "intellino_cluster.h"
+#include "intellino_csv.h"
+#include "intellino_dataset.h"
+#include "intellino_eval.h"
+#include "intellino_knn.h"
+
+static const int vector_max_len = Intellino_classifier::vector_max_len;
+
+// rows of a *.bin (mapped) or *.csv (parsed into rows), labels when the set has them
+struct Labeled_set{
+	Intellino_dataset dataset;
+	std::vector<char> storage;
+	std::vector<uint16_t> labels;
+	int count = 0;
+	int vector_length = 0;
+
+	const char (*rows () const)[vector_max_len]
+	{
+		return storage.empty() ? dataset.rows() : (const char (*)[vector_max_len])storage.data();
+	}
+};
+
+// row j of an unlabeled set: 1..255 and round again, so a chip category holds it
+static uint16_t row_label (int j)
+{
+	return (uint16_t)(j % 255 + 1);
+}
+
+static bool load (const char* path, Labeled_set& set)
+{
+	if (set.dataset.open(path)) {
+		set.count = set.dataset.size();
+		set.vector_length = set.dataset.vector_length();
+		if (set.dataset.has_labels())
+			set.labels.assign(set.dataset.labels(), set.dataset.labels() + set.count);
+		if (set.dataset.value_offset() != 0) {
+			set.storage.assign(set.dataset.rows()[0], set.dataset.rows()[0] + (size_t)set.count*vector_max_len);
+			for (int j=0; j<set.count; j++)
+				for (int i=0; i<set.vector_length; i++)
+					set.storage[(size_t)j*vector_max_len + i] -= (char)set.dataset.value_offset();
+		}
+		return true;
+	}
+	Intellino_csv_reader reader;
+	long rows = reader.read(path, [&](const char (*vectors)[vector_max_len], int count, int vector_length, long) {
+		if (set.vector_length == 0)
+			set.vector_length = vector_length;
+		set.storage.insert(set.storage.end(), vectors[0], vectors[0] + (size_t)count*vector_max_len);
+		return true;
+	});
+	if (rows <= 0)
+		return false;
+	set.count = (int)rows;
+	return true;
+}
+
+static void usage (const char* name)
+{
+	fprintf(stderr, "usage: %s [-d host|device] [-m l1|hamming] [-t threads] [-b chunk] [-r] [-x distance] [-c confusion.csv] train test...\n", name);
+	exit(2);
+}
+
+int main(int argc, char* argv[]){
+	const char* device = "host";
+	const char* confusion_file = NULL;
+	int threads = 0;
+	int chunk_rows = 1024;
+	bool row_labels = false;
+	int reject_distance = -1;
+	Intellino_knn::Metric metric = Intellino_knn::L1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:m:t:b:rx:c:")) != -1) {
+		switch (opt) {
+			case 'd'	:	device = optarg;
+						break;
+			case 'm'	:	if (strcmp(optarg, "hamming") == 0)
+							metric = Intellino_knn::HAMMING;
+						else if (strcmp(optarg, "l1") != 0)
+							usage(argv[0]);
+						break;
+			case 't'	:	threads = atoi(optarg);
+						break;
+			case 'b'	:	chunk_rows = atoi(optarg);
+						break;
+			case 'r'	:	row_labels = true;
+						break;
+			case 'x'	:	reject_distance = atoi(optarg);
+						break;
+			case 'c'	:	confusion_file = optarg;
+						break;
+			default		:	usage(argv[0]);
+		}
+	}
+	bool host = strcmp(device, "host") == 0;
+	if (argc - optind < 2 || chunk_rows < 1 || (metric == Intellino_knn::HAMMING && !host))
+		usage(argv[0]);
+
+	Labeled_set train;
+	if (!load(argv[optind], train)) {
+		fprintf(stderr, "%s: not a dataset or CSV\n", argv[optind]);
+		return 1;
+	}
+	std::vector<uint8_t> categories(train.count);
+	for (int j=0; j<train.count; j++) {
+		if (!train.labels.empty() && train.labels[j] > 255) {
+			fprintf(stderr, "%s: row %d has label %d, chip categories are 0..255\n", argv[optind], j + 1, train.labels[j]);
+			return 1;
+		}
+		categories[j] = train.labels.empty() ? row_label(j) : train.labels[j];
+	}
+
+	Intellino_knn knn(0, metric);
+	Intellino_classifier* chip = NULL;
+	if (host) {
+		for (int j=0; j<train.count; j++)
+			knn.learn(train.vector_length, (const uint8_t*)train.rows()[j], categories[j]);
+	}
+	else {
+		chip = intellino_open(device);
+		chip->learn_multi(train.count, train.vector_length, train.rows(), categories.data());
+	}
+	printf("%s: learned %d vectors of %d on %s%s\n", argv[optind], train.count, train.vector_length, device,
+		metric == Intellino_knn::HAMMING ? " (hamming)" : "");
+
+	FILE* confusion = NULL;
+	if (confusion_file && !(confusion = fopen(confusion_file, "a"))) {
+		perror(confusion_file);
+		return 1;
+	}
+	for (int i = optind + 1; i < argc; i++) {
+		Labeled_set test;
+		if (!load(argv[i], test)) {
+			fprintf(stderr, "%s: not a dataset or CSV\n", argv[i]);
+			return 1;
+		}
+		if (test.labels.empty() && row_labels)
+			for (int j=0; j<test.count; j++)
+				test.labels.push_back(row_label(j));
+		const uint16_t* labels = test.labels.empty() ? NULL : test.labels.data();
+
+		Intellino_evaluation result;
+		auto start = std::chrono::steady_clock::now();
+		if (host)
+			intellino_evaluate(knn, test.count, test.vector_length, test.rows(), labels, result, threads, chunk_rows, reject_distance);
+		else
+			intellino_evaluate(*chip, test.count, test.vector_length, test.rows(), labels, result, threads, chunk_rows, reject_distance);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("%s: %d vectors in %.3f s (%.0f vectors/s)\n", argv[i], test.count, seconds, test.count / seconds);
+		result.print_summary(stdout);
+		if (confusion) {
+			fprintf(confusion, "# %s\n", argv[i]);
+			result.write_confusion_csv(confusion);
+		}
+	}
+	if (confusion)
+		fclose(confusion);
+	delete chip;
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef INTELLINO_H
+#define INTELLINO_H
+
+/*
+ * C interface of libintellino. A handle wraps the same C++ classifier app.out uses
+ * (single chip, cluster or emulator), so C callers get the batched frames, the
+ * classify_multi_async pipeline and the metrics without a second implementation.
+ * Vectors are rows of INTELLINO_VECTOR_MAX_LEN bytes and are read in place.
+ * Functions returning int give 0 on success and -1 on a bad argument.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INTELLINO_VECTOR_MAX_LEN	64
+#define INTELLINO_MAX_DISTANCE		0xFFFF
+#define INTELLINO_UNKNOWN_CATEGORY	(-1)
+
+typedef struct intellino intellino_t;
+typedef struct intellino_job intellino_job_t;
+
+enum intellino_metrics_format { INTELLINO_METRICS_JSON, INTELLINO_METRICS_PROMETHEUS };
+
+/* devices as for INTELLINO_DEVICE: "/dev/spidev0.0", "emu", "emu:1024", or a comma
+ * separated list for a cluster; NULL reads INTELLINO_DEVICE (default /dev/spidev0.0) */
+intellino_t* intellino_create (const char* devices);
+void intellino_destroy (intellino_t* chip);
+
+int intellino_learn (intellino_t* chip, int vector_length, const char* learn_data, uint8_t learn_category);
+int intellino_learn_multi (intellino_t* chip, int multi_dataset_num, int vector_length,
+            const char learn_multi_data[][INTELLINO_VECTOR_MAX_LEN], const uint8_t* learn_multi_category);
+int intellino_classify (intellino_t* chip, int vector_length, const char* test_data,
+            int* classified_distance, int* classified_category);
+int intellino_classify_multi (intellino_t* chip, int multi_dataset_num, int vector_length,
+            const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category);
+/* query j's k nearest land in classified_topk_*[j*k .. j*k+k-1], closest first */
+int intellino_classify_topk (intellino_t* chip, int multi_dataset_num, int vector_length,
+            const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int k, int* classified_topk_distance, int* classified_topk_category);
+
+/* answers farther than reject_distance (>= 0) read INTELLINO_MAX_DISTANCE /
+ * INTELLINO_UNKNOWN_CATEGORY; returns how many were rejected, -1 on a bad argument */
+int intellino_classify_multi_within (intellino_t* chip, int reject_distance, int multi_dataset_num, int vector_length,
+            const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category);
+
+/* Queues the batch on the I/O thread and returns at once; the vectors and both result
+ * arrays must stay untouched until intellino_wait() returns. NULL on a bad argument. */
+intellino_job_t* intellino_classify_multi_async (intellino_t* chip, int multi_dataset_num, int vector_length,
+            const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category);
+/* blocks until the batch is answered and frees the job */
+void intellino_wait (intellino_job_t* job);
+
+/* latency histograms and throughput counters of every chip behind the handle */
+int intellino_write_metrics (intellino_t* chip, FILE* fp, enum intellino_metrics_format format);
+void intellino_reset_metrics (intellino_t* chip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <future>
+#include "intellino.h"
+#include "intellino_cluster.h"
+#include "intellino_metrics.h"
+
+static_assert(INTELLINO_VECTOR_MAX_LEN == Intellino_classifier::vector_max_len, "C rows must match classifier rows");
+static_assert(INTELLINO_MAX_DISTANCE == Intellino_classifier::max_distance, "C distances must match classifier distances");
+static_assert(INTELLINO_UNKNOWN_CATEGORY == Intellino_classifier::unknown_category, "C categories must match classifier categories");
+
+struct intellino{
+	Intellino_classifier* classifier;
+};
+
+struct intellino_job{
+	std::future<void> done;
+};
+
+static bool valid (const intellino_t* chip, int vector_length)
+{
+	return chip != NULL && vector_length > 0 && vector_length <= INTELLINO_VECTOR_MAX_LEN;
+}
+
+// -------------------
+// handle
+// -------------------
+intellino_t* intellino_create (const char* devices)
+{
+	intellino_t* chip = new intellino_t;
+	chip->classifier = intellino_open(devices);
+	return chip;
+}
+
+void intellino_destroy (intellino_t* chip)
+{
+	if (chip == NULL)
+		return;
+	delete chip->classifier;
+	delete chip;
+}
+
+// -------------------
+// learn / classify
+// -------------------
+int intellino_learn (intellino_t* chip, int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	if (!valid(chip, vector_length) || learn_data == NULL)
+		return -1;
+	chip->classifier->learn(vector_length, learn_data, learn_category);
+	return 0;
+}
+
+int intellino_learn_multi (intellino_t* chip, int multi_dataset_num, int vector_length,
+			const char learn_multi_data[][INTELLINO_VECTOR_MAX_LEN], const uint8_t* learn_multi_category)
+{
+	if (!valid(chip, vector_length) || multi_dataset_num < 0)
+		return -1;
+	chip->classifier->learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	return 0;
+}
+
+int intellino_classify (intellino_t* chip, int vector_length, const char* test_data,
+			int* classified_distance, int* classified_category)
+{
+	if (!valid(chip, vector_length) || test_data == NULL)
+		return -1;
+	chip->classifier->classify(vector_length, test_data, classified_distance, classified_category);
+	return 0;
+}
+
+int intellino_classify_multi (intellino_t* chip, int multi_dataset_num, int vector_length,
+			const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category)
+{
+	if (!valid(chip, vector_length) || multi_dataset_num < 0)
+		return -1;
+	chip->classifier->classify_multi(multi_dataset_num, vector_length, test_multi_data,
+					classified_multi_distance, classified_multi_category);
+	return 0;
+}
+
+int intellino_classify_topk (intellino_t* chip, int multi_dataset_num, int vector_length,
+			const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int k, int* classified_topk_distance, int* classified_topk_category)
+{
+	if (!valid(chip, vector_length) || multi_dataset_num < 0 || k <= 0)
+		return -1;
+	chip->classifier->classify_topk(multi_dataset_num, vector_length, test_multi_data, k,
+					classified_topk_distance, classified_topk_category);
+	return 0;
+}
+
+int intellino_classify_multi_within (intellino_t* chip, int reject_distance, int multi_dataset_num, int vector_length,
+			const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category)
+{
+	if (!valid(chip, vector_length) || multi_dataset_num < 0 || reject_distance < 0)
+		return -1;
+	return chip->classifier->classify_multi_within(reject_distance, multi_dataset_num, vector_length, test_multi_data,
+						classified_multi_distance, classified_multi_category);
+}
+
+// -------------------
+// async batches
+// -------------------
+intellino_job_t* intellino_classify_multi_async (intellino_t* chip, int multi_dataset_num, int vector_length,
+			const char test_multi_data[][INTELLINO_VECTOR_MAX_LEN], int* classified_multi_distance, int* classified_multi_category)
+{
+	if (!valid(chip, vector_length) || multi_dataset_num < 0)
+		return NULL;
+	intellino_job_t* job = new intellino_job_t;
+	job->done = chip->classifier->classify_multi_async(multi_dataset_num, vector_length, test_multi_data,
+					classified_multi_distance, classified_multi_category);
+	return job;
+}
+
+void intellino_wait (intellino_job_t* job)
+{
+	if (job == NULL)
+		return;
+	job->done.get();
+	delete job;
+}
+
+// -------------------
+// metrics
+// -------------------
+int intellino_write_metrics (intellino_t* chip, FILE* fp, enum intellino_metrics_format format)
+{
+	if (chip == NULL || fp == NULL)
+		return -1;
+	Intellino_metrics metrics;
+	chip->classifier->collect_metrics(metrics);
+	metrics.write(fp, format == INTELLINO_METRICS_PROMETHEUS ? Intellino_metrics::PROMETHEUS : Intellino_metrics::JSON);
+	return 0;
+}
+
+void intellino_reset_metrics (intellino_t* chip)
+{
+	if (chip != NULL)
+		chip->classifier->reset_metrics();
+}
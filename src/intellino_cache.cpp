@@ -0,0 +1,235 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "intellino_cache.h"
+#include "intellino_frame.h"
+
+static inline uint64_t rotl64 (uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+uint64_t intellino_row_hash (int vector_length, const uint8_t* row)
+{
+	uint64_t words[Intellino_classifier::vector_max_len / 8] = {};
+	if (vector_length > Intellino_classifier::vector_max_len)
+		vector_length = Intellino_classifier::vector_max_len;
+	if (vector_length > 0)
+		memcpy(words, row, vector_length);
+	uint64_t h = 0x27D4EB2F165667C5ull ^ ((uint64_t)vector_length * 0x9E3779B97F4A7C15ull);
+	for (int i=0; i<Intellino_classifier::vector_max_len / 8; i++)
+		h = rotl64(h ^ (words[i] * 0xC2B2AE3D27D4EB4Full), 31) * 0x9E3779B97F4A7C15ull;
+	// final avalanche (murmur3 fmix64)
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+Intellino_cache::Intellino_cache(Intellino_classifier* chip, const Intellino_cache_policy& policy){
+	this->chip = chip;
+	this->policy = policy;
+	if (this->policy.capacity < 0)
+		this->policy.capacity = 0;
+	if (this->policy.shards < 1)
+		this->policy.shards = 1;
+	shard_capacity = (this->policy.capacity + this->policy.shards - 1) / this->policy.shards;
+	shards = new Shard[this->policy.shards];
+}
+
+Intellino_cache::~Intellino_cache(){
+	stop_async();
+	delete[] shards;
+	delete chip;
+}
+
+// -------------------
+// LRU
+// -------------------
+bool Intellino_cache::lookup (uint64_t hash, int vector_length, const uint8_t* row, int *distance, int *category)
+{
+	if (shard_capacity == 0)
+		return false;
+	Shard& shard = shard_of(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.index.find(hash);
+	if (found == shard.index.end())
+		return false;
+	Entry& entry = *found->second;
+	if (entry.generation != generation) {
+		shard.lru.erase(found->second);
+		shard.index.erase(found);
+		return false;
+	}
+	if (entry.vector_length != vector_length || memcmp(entry.row, row, vector_length) != 0)
+		return false;
+	*distance = entry.distance;
+	*category = entry.category;
+	shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+	return true;
+}
+
+// generation is the one read before the chip was asked, so an answer that raced a learn
+// goes in already stale
+void Intellino_cache::insert (uint64_t hash, uint64_t generation, int vector_length, const uint8_t* row, int distance, int category)
+{
+	if (shard_capacity == 0)
+		return;
+	Shard& shard = shard_of(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto found = shard.index.find(hash);
+	if (found != shard.index.end()) {
+		shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+	}
+	else {
+		if ((int)shard.lru.size() >= shard_capacity) {
+			shard.index.erase(shard.lru.back().hash);
+			shard.lru.pop_back();
+		}
+		shard.lru.emplace_front();
+		shard.index[hash] = shard.lru.begin();
+	}
+	Entry& entry = shard.lru.front();
+	entry.hash = hash;
+	entry.generation = generation;
+	entry.vector_length = vector_length;
+	entry.distance = distance;
+	entry.category = category;
+	memcpy(entry.row, row, vector_length);
+}
+
+// -------------------
+// learn
+// -------------------
+void Intellino_cache::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	chip->learn(vector_length, learn_data, learn_category);
+	generation++;
+}
+
+void Intellino_cache::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	chip->learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	generation++;
+}
+
+// -------------------
+// classify
+// -------------------
+// vectors are cut to vector_max_len bytes like on the chip, so cache entries and the
+// dedup copies never hold more; empty ones go straight to the chip
+void Intellino_cache::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	if (vector_length < 1) {
+		chip->classify(vector_length, test_data, classified_distance, classified_category);
+		return;
+	}
+	if (vector_length > vector_max_len)
+		vector_length = vector_max_len;
+	queries++;
+	uint64_t hash = intellino_row_hash(vector_length, (const uint8_t*)test_data);
+	if (lookup(hash, vector_length, (const uint8_t*)test_data, classified_distance, classified_category)) {
+		hits++;
+		bytes_saved += classify_frame_len(vector_length);
+		return;
+	}
+	uint64_t asked = generation;
+	chip->classify(vector_length, test_data, classified_distance, classified_category);
+	insert(hash, asked, vector_length, (const uint8_t*)test_data, *classified_distance, *classified_category);
+}
+
+void Intellino_cache::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	if (multi_dataset_num <= 0)
+		return;
+	if (vector_length < 1) {
+		chip->classify_multi(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category);
+		return;
+	}
+	if (vector_length > vector_max_len)
+		vector_length = vector_max_len;
+	queries += multi_dataset_num;
+	uint64_t asked = generation;
+
+	// source[j]: -1 answered from the cache, otherwise the unique miss that answers query j
+	std::vector<uint64_t> hashes(multi_dataset_num);
+	std::vector<int> source(multi_dataset_num);
+	std::vector<int> unique;
+	std::unordered_map<uint64_t, int> seen;
+	long cached = 0;
+	long repeated = 0;
+	for (int j=0; j<multi_dataset_num; j++) {
+		const uint8_t* row = (const uint8_t*)test_multi_data[j];
+		hashes[j] = intellino_row_hash(vector_length, row);
+		if (lookup(hashes[j], vector_length, row, classified_multi_distance + j, classified_multi_category + j)) {
+			source[j] = -1;
+			cached++;
+			continue;
+		}
+		auto first = seen.find(hashes[j]);
+		if (first != seen.end() && memcmp(test_multi_data[unique[first->second]], row, vector_length) == 0) {
+			source[j] = first->second;
+			repeated++;
+			continue;
+		}
+		source[j] = (int)unique.size();
+		if (first == seen.end())
+			seen[hashes[j]] = source[j];
+		unique.push_back(j);
+	}
+	hits += cached;
+	duplicates += repeated;
+	bytes_saved += (cached + repeated) * classify_frame_len(vector_length);
+	if (unique.empty())
+		return;
+
+	// the common all-miss batch goes to the chip as it is
+	if ((int)unique.size() == multi_dataset_num) {
+		chip->classify_multi(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category);
+		for (int j=0; j<multi_dataset_num; j++)
+			insert(hashes[j], asked, vector_length, (const uint8_t*)test_multi_data[j],
+					classified_multi_distance[j], classified_multi_category[j]);
+		return;
+	}
+
+	int misses = (int)unique.size();
+	std::vector<char> rows((size_t)misses * vector_max_len);
+	std::vector<int> distance(misses), category(misses);
+	for (int u=0; u<misses; u++)
+		memcpy(&rows[(size_t)u * vector_max_len], test_multi_data[unique[u]], vector_length);
+	chip->classify_multi(misses, vector_length, (const char (*)[vector_max_len])rows.data(), distance.data(), category.data());
+	for (int u=0; u<misses; u++)
+		insert(hashes[unique[u]], asked, vector_length, (const uint8_t*)test_multi_data[unique[u]], distance[u], category[u]);
+	for (int j=0; j<multi_dataset_num; j++) {
+		if (source[j] < 0)
+			continue;
+		classified_multi_distance[j] = distance[source[j]];
+		classified_multi_category[j] = category[source[j]];
+	}
+}
+
+void Intellino_cache::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	chip->classify_topk(multi_dataset_num, vector_length, test_multi_data, k, classified_topk_distance, classified_topk_category);
+}
+
+// -------------------
+// stats
+// -------------------
+Intellino_cache::Stats Intellino_cache::stats () const
+{
+	return Stats{queries, hits, duplicates, bytes_saved};
+}
+
+void Intellino_cache::print_stats (FILE* fp) const
+{
+	Stats s = stats();
+	fprintf(fp, "cache: %ld queries, %ld hits, %ld in-batch duplicates (%.1f%% not sent), %ld frame bytes saved\n",
+		s.queries, s.hits, s.duplicates, 100 * s.hit_rate(), s.bytes_saved);
+}
@@ -0,0 +1,93 @@
+#ifndef INTELLINO_CACHE_H
+#define INTELLINO_CACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "intellino_classifier.h"
+
+// capacity: answers kept over all shards (0 disables the LRU, in-batch dedup still runs)
+// shards: independently locked LRU lists, so concurrent callers rarely wait on each other
+struct Intellino_cache_policy{
+    int capacity = 4096;
+    int shards = 16;
+};
+
+// hash of the first vector_length bytes of a row (the rest is ignored), one pass over
+// eight 64-bit words
+uint64_t intellino_row_hash(int vector_length, const uint8_t* row);
+
+// Answers repeated query vectors without a CLASSIFY frame. classify / classify_multi look
+// every vector up in a sharded LRU keyed by its hash (the stored row is compared too, so a
+// collision is only a miss); the misses of a batch are deduplicated, the unique ones go to
+// the chip in one classify_multi and their answers fill every copy and the cache. Any
+// learn invalidates all cached answers. classify_topk passes straight through.
+class Intellino_cache : public Intellino_classifier{
+private:
+    struct Entry{
+        uint64_t hash;
+        uint64_t generation;
+        int vector_length;
+        int distance;
+        int category;
+        uint8_t row[vector_max_len];
+    };
+    struct Shard{
+        std::mutex mutex;
+        std::list<Entry> lru;           // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    };
+
+    Intellino_classifier* chip;
+    Intellino_cache_policy policy;
+    int shard_capacity;
+    Shard* shards;
+    // bumped after every learn; entries from an older generation are never returned
+    std::atomic<uint64_t> generation{0};
+
+    std::atomic<long> queries{0};
+    std::atomic<long> hits{0};
+    std::atomic<long> duplicates{0};
+    std::atomic<long> bytes_saved{0};
+
+    Shard& shard_of (uint64_t hash) { return shards[(hash >> 32) % policy.shards]; }
+    bool lookup (uint64_t hash, int vector_length, const uint8_t* row, int *distance, int *category);
+    void insert (uint64_t hash, uint64_t generation, int vector_length, const uint8_t* row, int distance, int category);
+
+public:
+    // takes ownership of chip
+    Intellino_cache(Intellino_classifier* chip, const Intellino_cache_policy& policy = Intellino_cache_policy());
+    ~Intellino_cache();
+    Intellino_cache(const Intellino_cache&) = delete;
+    Intellino_cache& operator=(const Intellino_cache&) = delete;
+
+    // drops every cached answer
+    void invalidate () { generation++; }
+
+    void collect_metrics (Intellino_metrics& total) { chip->collect_metrics(total); }
+    void reset_metrics () { chip->reset_metrics(); }
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+
+    struct Stats{
+        long queries;
+        long hits;              // answered from the cache
+        long duplicates;        // repeats of another miss in the same batch
+        long bytes_saved;       // CLASSIFY frame bytes the hits and duplicates did not send
+        double hit_rate () const { return queries ? (double)(hits + duplicates) / queries : 0; }
+    };
+    Stats stats () const;
+    void print_stats (FILE* fp) const;
+};
+
+#endif
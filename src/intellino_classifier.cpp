@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include "intellino_classifier.h"
+
+Intellino_classifier::~Intellino_classifier(){
+	stop_async();
+}
+
+void Intellino_classifier::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	for (int j=0; j<multi_dataset_num; j++)
+		learn(vector_length, learn_multi_data[j], learn_multi_category[j]);
+}
+
+// ------------------------------
+// intellino CLASSIFY_MULTI (distance bound)
+// ------------------------------
+int Intellino_classifier::reject_beyond (int reject_distance, int multi_dataset_num,
+					int *classified_multi_distance, int *classified_multi_category)
+{
+	int rejected = 0;
+	for (int j=0; j<multi_dataset_num; j++) {
+		if (classified_multi_category[j] != unknown_category && classified_multi_distance[j] <= reject_distance)
+			continue;
+		classified_multi_distance[j] = max_distance;
+		classified_multi_category[j] = unknown_category;
+		rejected++;
+	}
+	return rejected;
+}
+
+// a chip always returns its nearest neuron, so the bound is applied to the answers
+int Intellino_classifier::classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	classify_multi(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category);
+	return reject_beyond(reject_distance, multi_dataset_num, classified_multi_distance, classified_multi_category);
+}
+
+void Intellino_classifier::stop_async ()
+{
+	if (!io_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(io_mutex);
+		io_stop = true;
+	}
+	io_cv.notify_one();
+	io_thread.join();
+}
+
+// ------------------------------
+// intellino CLASSIFY_MULTI (async)
+// ------------------------------
+// Lets the caller parse batch N+1 and post-process batch N-1 while batch N is on the bus.
+std::future<void> Intellino_classifier::classify_multi_async (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category,
+					int reject_distance)
+{
+	std::future<void> done;
+	{
+		std::lock_guard<std::mutex> lock(io_mutex);
+		if (!io_thread.joinable())
+			io_thread = std::thread(&Intellino_classifier::io_loop, this);
+		io_jobs.push_back(Async_job{multi_dataset_num, vector_length, test_multi_data,
+						classified_multi_distance, classified_multi_category, reject_distance, std::promise<void>()});
+		done = io_jobs.back().done.get_future();
+	}
+	io_cv.notify_one();
+	return done;
+}
+
+void Intellino_classifier::io_loop()
+{
+	std::unique_lock<std::mutex> lock(io_mutex);
+	while (true) {
+		io_cv.wait(lock, [this]{ return io_stop || !io_jobs.empty(); });
+		if (io_jobs.empty())
+			return;
+
+		Async_job job = std::move(io_jobs.front());
+		io_jobs.pop_front();
+		lock.unlock();
+		if (job.reject_distance < 0)
+			classify_multi(job.multi_dataset_num, job.vector_length, job.test_multi_data,
+					job.classified_multi_distance, job.classified_multi_category);
+		else
+			classify_multi_within(job.reject_distance, job.multi_dataset_num, job.vector_length, job.test_multi_data,
+					job.classified_multi_distance, job.classified_multi_category);
+		job.done.set_value();
+		lock.lock();
+	}
+}
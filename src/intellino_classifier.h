@@ -0,0 +1,74 @@
+#ifndef INTELLINO_CLASSIFIER_H
+#define INTELLINO_CLASSIFIER_H
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+class Intellino_metrics;
+
+// Common learn / classify interface of a single chip (Intellino_spi) and of the
+// front ends stacked on top of it, so callers can switch between them freely.
+class Intellino_classifier{
+public:
+    static const int vector_max_len = 64;
+    static const int max_distance = 0xFFFF;
+    static const int unknown_category = -1;     // answer rejected by a distance bound
+
+    virtual ~Intellino_classifier();
+    virtual void learn (int vector_length, const char* learn_data, uint8_t learn_category) = 0;
+    // learns rows in order, same result as learn() on each; chips stream all frames in as few bus messages as possible
+    virtual void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    virtual void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category) = 0;
+    virtual void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category) = 0;
+    // k nearest per query, closest first (ties: earliest learned); query j's winners land in
+    // classified_topk_*[j*k .. j*k+k-1], missing winners read 0xFFFF / category 0
+    virtual void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category) = 0;
+    // classify_multi where every answer farther than reject_distance reads max_distance /
+    // unknown_category; returns how many were rejected. Host engines stop searching past the bound.
+    virtual int classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+
+    // adds the Intellino_metrics of every chip behind this classifier into total
+    virtual void collect_metrics (Intellino_metrics&) {}
+    virtual void reset_metrics () {}
+
+    // Queues the batch for the I/O thread and returns immediately. The vectors and both
+    // result arrays must stay untouched until the future is ready. reject_distance >= 0
+    // runs it as classify_multi_within.
+    std::future<void> classify_multi_async (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category,
+                int reject_distance = -1);
+
+protected:
+    // marks the answers farther than reject_distance as unknown, returns the unknown count
+    static int reject_beyond (int reject_distance, int multi_dataset_num, int *classified_multi_distance, int *classified_multi_category);
+    // Derived destructors call this first: queued jobs still need their classify_multi().
+    void stop_async ();
+
+private:
+    // classify_multi_async() jobs, run in order by a single I/O thread started on first use
+    struct Async_job{
+        int multi_dataset_num;
+        int vector_length;
+        const char (*test_multi_data)[vector_max_len];
+        int *classified_multi_distance;
+        int *classified_multi_category;
+        int reject_distance;
+        std::promise<void> done;
+    };
+    std::thread io_thread;
+    std::mutex io_mutex;
+    std::condition_variable io_cv;
+    std::deque<Async_job> io_jobs;
+    bool io_stop = false;
+    void io_loop();
+};
+
+#endif
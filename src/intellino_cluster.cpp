@@ -0,0 +1,288 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include "intellino_cluster.h"
+#include "intellino_index.h"
+
+Intellino_cluster::Intellino_cluster(const std::vector<Intellino_spi*>& chips, const std::vector<int>& capacities){
+	for (size_t i=0; i<chips.size(); i++)
+		this->chips.push_back(Chip{chips[i], capacities[i], 0});
+}
+
+Intellino_cluster::~Intellino_cluster(){
+	stop_async();
+	for (Chip& chip : chips)
+		delete chip.spi;
+}
+
+int Intellino_cluster::learned() const
+{
+	std::lock_guard<std::mutex> lock(chips_mutex);
+	int total = 0;
+	for (const Chip& chip : chips)
+		total += chip.learned;
+	return total;
+}
+
+void Intellino_cluster::collect_metrics (Intellino_metrics& total)
+{
+	for (Chip& chip : chips)
+		chip.spi->collect_metrics(total);
+}
+
+void Intellino_cluster::reset_metrics ()
+{
+	for (Chip& chip : chips)
+		chip.spi->reset_metrics();
+}
+
+// -------------------
+// cluster LEARN
+// -------------------
+// Vectors past the last chip's capacity are dropped, as a single full chip would.
+void Intellino_cluster::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	std::lock_guard<std::mutex> lock(chips_mutex);
+	int index = active_chips > 0 ? active_chips - 1 : 0;
+	while (index < (int)chips.size() && chips[index].learned >= chips[index].capacity)
+		index++;
+	if (index == (int)chips.size())
+		return;
+
+	chips[index].spi->learn(vector_length, learn_data, learn_category);
+	chips[index].learned++;
+	if (index >= active_chips)
+		active_chips = index + 1;
+}
+
+// Each chip takes as many of the rows as it has neurons left, in one learn_multi.
+// The chips sit on separate buses, so their shares are sent in parallel.
+void Intellino_cluster::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	struct Share{
+		int chip;
+		int first;
+		int count;
+	};
+	std::lock_guard<std::mutex> lock(chips_mutex);
+	std::vector<Share> shares;
+	int index = active_chips > 0 ? active_chips - 1 : 0;
+	int first = 0;
+	while (first < multi_dataset_num && index < (int)chips.size()) {
+		int room = chips[index].capacity - chips[index].learned;
+		if (room <= 0) {
+			index++;
+			continue;
+		}
+		int n = multi_dataset_num - first < room ? multi_dataset_num - first : room;
+		shares.push_back(Share{index, first, n});
+		chips[index].learned += n;
+		if (index >= active_chips)
+			active_chips = index + 1;
+		first += n;
+	}
+	if (shares.empty())
+		return;
+
+	auto send = [&](const Share& share) {
+		chips[share.chip].spi->learn_multi(share.count, vector_length,
+				learn_multi_data + share.first, learn_multi_category + share.first);
+	};
+	std::vector<std::thread> senders;
+	for (size_t s=1; s<shares.size(); s++)
+		senders.emplace_back(send, std::cref(shares[s]));
+	send(shares[0]);
+	for (std::thread& sender : senders)
+		sender.join();
+}
+
+// -------------------
+// cluster CLASSIFY
+// -------------------
+// chips holding vectors when the call starts (at least chip 0)
+int Intellino_cluster::classify_chips () const
+{
+	std::lock_guard<std::mutex> lock(chips_mutex);
+	return active_chips > 0 ? active_chips : 1;
+}
+
+void Intellino_cluster::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	classify_multi(1, vector_length, (const char (*)[vector_max_len])test_data, classified_distance, classified_category);
+}
+
+// ------------------------
+// cluster CLASSIFY_MULTI
+// ------------------------
+// Chip 0 answers straight into the caller's arrays on this thread, the other chips into
+// this call's own arrays on their I/O threads; then each query keeps the closest answer.
+void Intellino_cluster::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	int active = classify_chips();
+	size_t rows = multi_dataset_num > 0 ? multi_dataset_num : 0;
+	std::vector<int> distance(rows*(active - 1)), category(rows*(active - 1));
+	std::vector<std::future<void>> pending;
+	for (int c=1; c<active; c++)
+		pending.push_back(chips[c].spi->classify_multi_async(multi_dataset_num, vector_length, test_multi_data,
+							distance.data() + rows*(c-1), category.data() + rows*(c-1)));
+	chips[0].spi->classify_multi(multi_dataset_num, vector_length, test_multi_data,
+					classified_multi_distance, classified_multi_category);
+
+	for (int c=1; c<active; c++) {
+		pending[c-1].get();
+		const int* chip_distance = distance.data() + rows*(c-1);
+		const int* chip_category = category.data() + rows*(c-1);
+		for (size_t j=0; j<rows; j++) {
+			if (chip_distance[j] < classified_multi_distance[j]) {
+				classified_multi_distance[j] = chip_distance[j];
+				classified_multi_category[j] = chip_category[j];
+			}
+		}
+	}
+}
+
+// ------------------------
+// cluster CLASSIFY_TOPK
+// ------------------------
+// Every chip ranks its own k best in parallel; the merge keeps the k smallest distances,
+// lower chip first on ties, which is learn order across the cluster.
+void Intellino_cluster::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	if (multi_dataset_num <= 0 || k <= 0)
+		return;
+	int active = classify_chips();
+	if (active == 1) {
+		chips[0].spi->classify_topk(multi_dataset_num, vector_length, test_multi_data, k,
+						classified_topk_distance, classified_topk_category);
+		return;
+	}
+
+	size_t per_chip = (size_t)multi_dataset_num*k;
+	std::vector<int> distance(per_chip*active), category(per_chip*active);
+	auto rank = [&](int c) {
+		chips[c].spi->classify_topk(multi_dataset_num, vector_length, test_multi_data, k,
+						&distance[per_chip*c], &category[per_chip*c]);
+	};
+	std::vector<std::thread> rankers;
+	for (int c=1; c<active; c++)
+		rankers.emplace_back(rank, c);
+	rank(0);
+	for (std::thread& ranker : rankers)
+		ranker.join();
+
+	// each chip's list is sorted, so a k-way merge with the cursor of every chip
+	std::vector<int> cursor(active);
+	for (int j=0; j<multi_dataset_num; j++) {
+		size_t row = (size_t)j*k;
+		for (int c=0; c<active; c++)
+			cursor[c] = 0;
+		for (int r=0; r<k; r++) {
+			int best = 0;
+			for (int c=1; c<active; c++)
+				if (distance[per_chip*c + row + cursor[c]] < distance[per_chip*best + row + cursor[best]])
+					best = c;
+			classified_topk_distance[row + r] = distance[per_chip*best + row + cursor[best]];
+			classified_topk_category[row + r] = category[per_chip*best + row + cursor[best]];
+			cursor[best]++;
+		}
+	}
+}
+
+// -------------------
+// device list
+// -------------------
+static int env_chip_neurons()
+{
+	const char* neurons = getenv("INTELLINO_CHIP_NEURONS");
+	return neurons ? atoi(neurons) : default_chip_neurons;
+}
+
+// INTELLINO_HOST_TOPK=1: every chip keeps the host copy classify_topk ranks from
+static bool env_host_topk()
+{
+	const char* topk = getenv("INTELLINO_HOST_TOPK");
+	return topk && atoi(topk);
+}
+
+static int device_neurons(const char* device, int chip_neurons)
+{
+	if (strncmp(device, "emu:", 4) == 0)
+		return atoi(device + 4);
+	return chip_neurons;
+}
+
+static bool is_index(const char* device)
+{
+	return strncmp(device, "index", 5) == 0 && (device[5] == '\0' || device[5] == ':');
+}
+
+// "index[:tables[:bits[:probes]]]", unset fields keep the Intellino_index_config defaults
+static Intellino_classifier* open_index(const char* device)
+{
+	Intellino_index_config config;
+	sscanf(device + 5, ":%d:%d:%d", &config.tables, &config.bits, &config.probes);
+	return new Intellino_index(config);
+}
+
+Intellino_classifier* intellino_open (const char* devices)
+{
+	if (devices == NULL)
+		devices = getenv("INTELLINO_DEVICE");
+	if (devices == NULL)
+		return new Intellino_spi(intellino_open_transport((const char*)NULL), env_chip_neurons(), env_host_topk());
+	if (strchr(devices, ',') == NULL && is_index(devices))
+		return open_index(devices);
+	if (strchr(devices, ',') == NULL)
+		return new Intellino_spi(intellino_open_transport(devices), intellino_neurons(devices), env_host_topk());
+
+	int chip_neurons = env_chip_neurons();
+
+	std::vector<Intellino_spi*> chips;
+	std::vector<int> capacities;
+	std::string list(devices);
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+		std::string device = list.substr(start, end - start);
+		if (!device.empty()) {
+			int capacity = device_neurons(device.c_str(), chip_neurons);
+			chips.push_back(new Intellino_spi(intellino_open_transport(device.c_str()), capacity, env_host_topk()));
+			capacities.push_back(capacity);
+		}
+		start = end + 1;
+	}
+	return new Intellino_cluster(chips, capacities);
+}
+
+int intellino_neurons (const char* devices)
+{
+	if (devices == NULL)
+		devices = getenv("INTELLINO_DEVICE");
+	if (devices == NULL)
+		return env_chip_neurons();
+	if (strchr(devices, ',') == NULL)
+		return strcmp(devices, "emu") == 0 || is_index(devices) ? 0 : device_neurons(devices, env_chip_neurons());
+
+	int chip_neurons = env_chip_neurons();
+	int total = 0;
+	std::string list(devices);
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+		std::string device = list.substr(start, end - start);
+		if (!device.empty())
+			total += device_neurons(device.c_str(), chip_neurons);
+		start = end + 1;
+	}
+	return total;
+}
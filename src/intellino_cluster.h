@@ -0,0 +1,65 @@
+#ifndef INTELLINO_CLUSTER_H
+#define INTELLINO_CLUSTER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include "intellino_classifier.h"
+#include "intellino_spi.h"
+
+// Several Intellinos behind one classifier. learn() fills chip 0 up to its neuron
+// capacity, then chip 1, and so on. classify/classify_multi run on every chip that
+// holds vectors in parallel (each chip on its own I/O thread) and keep the smallest
+// distance; equal distances go to the lower chip, which is the neuron learned first,
+// so results match one chip large enough to hold everything. Every call may run
+// concurrently with any other, classify_multi_async's I/O thread included: answers go to
+// per-call buffers and the fill counts are only touched under chips_mutex.
+class Intellino_cluster : public Intellino_classifier{
+private:
+    struct Chip{
+        Intellino_spi* spi;
+        int capacity;
+        int learned;
+    };
+    std::vector<Chip> chips;
+    int active_chips = 0;     // chips[0 .. active_chips) hold at least one vector
+    // held across learn / learn_multi, so vectors reach the chips in learn order
+    mutable std::mutex chips_mutex;
+
+    int classify_chips () const;
+
+public:
+    // capacities[i] = neurons of chip i; the cluster owns the chips
+    Intellino_cluster(const std::vector<Intellino_spi*>& chips, const std::vector<int>& capacities);
+    ~Intellino_cluster();
+    Intellino_cluster(const Intellino_cluster&) = delete;
+    Intellino_cluster& operator=(const Intellino_cluster&) = delete;
+
+    int size() const { return (int)chips.size(); }
+    int learned() const;
+    Intellino_spi& chip(int index) { return *chips[index].spi; }
+
+    void collect_metrics (Intellino_metrics& total);
+    void reset_metrics ();
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+};
+
+// INTELLINO_DEVICE style device list: one entry opens an Intellino_spi, a comma separated
+// list ("/dev/spidev0.0,/dev/spidev0.1" or "emu:100,emu:100") opens an Intellino_cluster.
+// Chip capacity comes from "emu:<neurons>" or else INTELLINO_CHIP_NEURONS (default below).
+// "index[:tables[:bits[:probes]]]" opens the host Intellino_index, which has no capacity.
+// NULL reads INTELLINO_DEVICE, falling back to Intellino_spi's default device.
+static const int default_chip_neurons = 1024;
+Intellino_classifier* intellino_open (const char* devices);
+// Neurons behind the same device list (sum over a cluster); 0 for a bare "emu" or an index, which never fill up.
+int intellino_neurons (const char* devices);
+
+#endif
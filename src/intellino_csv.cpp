@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "intellino_csv.h"
+
+static const int vector_max_len = Intellino_csv_reader::vector_max_len;
+static const size_t chunk_bytes = 1 << 20;
+
+// ------------------------------
+// chunk parser
+// ------------------------------
+// Separators (',' '\t' ' ' '\r' '\n') are found 16 bytes at a time; each field between
+// two separators is one value. Empty fields are skipped like strtok did, lines with
+// fewer than min_vector_len values, non-digit characters or fields of more than
+// max_digits digits are skipped and listed in chunk.skipped.
+struct Chunk_parser{
+	Intellino_csv_reader::Chunk& chunk;
+	int value_offset;
+	const char* field;
+	char row[vector_max_len];
+	int values = 0;
+	bool bad_line = false;
+
+	Chunk_parser(Intellino_csv_reader::Chunk& c, int offset) : chunk(c), value_offset(offset), field(c.begin) {}
+
+	inline void end_field (const char* separator)
+	{
+		if (separator > field) {
+			int value = 0;
+			bad_line |= separator - field > Intellino_csv_reader::max_digits;
+			for (const char* q = field; q < separator && q < field + Intellino_csv_reader::max_digits; q++) {
+				unsigned digit = (unsigned)(*q - '0');
+				bad_line |= digit > 9;
+				value = value*10 + digit;
+			}
+			if (values < vector_max_len)
+				row[values] = (char)(value + value_offset);
+			values++;
+		}
+		field = separator + 1;
+	}
+
+	// false once a line is too long, the chunk stops there
+	inline bool end_line ()
+	{
+		chunk.lines++;
+		if (values > vector_max_len) {
+			chunk.error_line = chunk.lines;
+			chunk.error_values = values;
+			return false;
+		}
+		if (values >= Intellino_csv_reader::min_vector_len && !bad_line) {
+			size_t at = chunk.rows.size();
+			chunk.rows.resize(at + vector_max_len);
+			memcpy(&chunk.rows[at], row, values);
+			memset(&chunk.rows[at + values], 0, vector_max_len - values);
+			chunk.lengths.push_back((uint8_t)values);
+		}
+		else if (values > 0) {
+			chunk.skipped.push_back({chunk.lines, bad_line ? -1 : values, (long)chunk.lengths.size()});
+		}
+		values = 0;
+		bad_line = false;
+		return true;
+	}
+
+	void run ()
+	{
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		chunk.rows.clear();
+		chunk.lengths.clear();
+		chunk.lines = 0;
+		chunk.error_line = -1;
+		chunk.skipped.clear();
+		chunk.rows.reserve((end - p) / 3 * vector_max_len / 64);
+
+#if defined(__SSE2__)
+		const __m128i comma = _mm_set1_epi8(',');
+		const __m128i tab = _mm_set1_epi8('\t');
+		const __m128i space = _mm_set1_epi8(' ');
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lf = _mm_set1_epi8('\n');
+		for (; p + 16 <= end; p += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)p);
+			__m128i newline = _mm_cmpeq_epi8(v, lf);
+			__m128i separator = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, tab)),
+						_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, cr)));
+			unsigned newline_mask = (unsigned)_mm_movemask_epi8(newline);
+			unsigned separator_mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(separator, newline));
+			while (separator_mask) {
+				int i = __builtin_ctz(separator_mask);
+				end_field(p + i);
+				if ((newline_mask >> i) & 1)
+					if (!end_line())
+						return;
+				separator_mask &= separator_mask - 1;
+			}
+		}
+#endif
+		for (; p < end; p++) {
+			char c = *p;
+			if (c == ',' || c == '\t' || c == ' ' || c == '\r' || c == '\n') {
+				end_field(p);
+				if (c == '\n' && !end_line())
+					return;
+			}
+		}
+		end_field(end);
+		if (values > 0)
+			end_line();
+	}
+};
+
+// ------------------------------
+// Intellino_csv_reader
+// ------------------------------
+Intellino_csv_reader::Intellino_csv_reader(int batch_rows, int threads){
+	this->batch_rows = batch_rows > 0 ? batch_rows : 1024;
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	this->threads = threads > 0 ? threads : 1;
+}
+
+long Intellino_csv_reader::read (const char* path, const Batch_fn& on_batch)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return read_error;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int error = errno;
+		close(fd);
+		errno = error;
+		return read_error;
+	}
+	size_t size = st.st_size;
+	if (size == 0) {
+		close(fd);
+		return 0;
+	}
+	const char* data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int error = errno;
+	close(fd);
+	if (data == MAP_FAILED) {
+		errno = error;
+		return read_error;
+	}
+	madvise((void*)data, size, MADV_SEQUENTIAL);
+
+	std::vector<Chunk> window(threads);
+	std::vector<std::thread> workers;
+	const char* pos = data;
+	const char* data_end = data + size;
+	long delivered = 0;
+	long line_base = 0;
+	bool stop = false;
+
+	while (pos < data_end && !stop) {
+		// cut the next window into chunks that end on a line boundary
+		int chunks = 0;
+		for (; chunks < threads && pos < data_end; chunks++) {
+			const char* end = pos + chunk_bytes < data_end ? pos + chunk_bytes : data_end;
+			if (end < data_end) {
+				const char* newline = (const char*)memchr(end, '\n', data_end - end);
+				end = newline ? newline + 1 : data_end;
+			}
+			window[chunks].begin = pos;
+			window[chunks].end = end;
+			pos = end;
+		}
+
+		workers.clear();
+		for (int i=1; i<chunks; i++)
+			workers.emplace_back([this, &window, i]{ Chunk_parser(window[i], value_offset).run(); });
+		Chunk_parser(window[0], value_offset).run();
+		for (std::thread& worker : workers)
+			worker.join();
+
+		// deliver in file order, batches never mix vector lengths
+		for (int i=0; i<chunks && !stop; i++) {
+			Chunk& chunk = window[i];
+			long count = (long)chunk.lengths.size();
+			const char (*rows)[vector_max_len] = (const char (*)[vector_max_len])chunk.rows.data();
+			long first = 0;
+			while (first < count && !stop) {
+				int vector_length = chunk.lengths[first];
+				long n = 1;
+				while (first + n < count && n < batch_rows && chunk.lengths[first + n] == vector_length)
+					n++;
+				if (max_rows >= 0 && delivered + n >= max_rows) {
+					n = max_rows - delivered;
+					stop = true;
+				}
+				if (n > 0 && !on_batch(rows + first, (int)n, vector_length, delivered))
+					stop = true;
+				delivered += n;
+				first += n;
+			}
+			// the baseline's warning for short lines; lines past max_rows stay quiet
+			for (const Chunk::Skipped& line : chunk.skipped) {
+				if (stop && line.row >= first)
+					break;
+				if (line.values < 0)
+					fprintf(stderr, "%s:%ld: not a number of at most %d digits, line skipped\n", path, line_base + line.line, max_digits);
+				else
+					fprintf(stderr, "%s:%ld: %d values, fewer than %d, line skipped\n", path, line_base + line.line, line.values, min_vector_len);
+			}
+			if (chunk.error_line >= 0) {
+				fprintf(stderr, "%s:%ld: %d values, at most %d\n", path, line_base + chunk.error_line, chunk.error_values, vector_max_len);
+				munmap((void*)data, size);
+				return format_error;
+			}
+			line_base += chunk.lines;
+		}
+	}
+
+	munmap((void*)data, size);
+	return delivered;
+}
@@ -0,0 +1,64 @@
+#ifndef INTELLINO_CSV_H
+#define INTELLINO_CSV_H
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+// Streaming descriptor CSV reader: one vector per line, values 0..255 separated by
+// ',' or '\t'. The file is mapped and cut into chunks at line boundaries; chunks are
+// parsed in parallel (SIMD separator scan, one multiply-add per digit) and delivered
+// in file order as batches of rows laid out as char[][vector_max_len], ready for
+// classify_multi().
+class Intellino_csv_reader{
+public:
+    static const int vector_max_len = 64;
+    static const int min_vector_len = 5;
+    static const int max_digits = 9;       // longer fields would overflow the int they are summed in
+
+    // rows: count rows of vector_length values (zero padded), first_row: 0-based index of
+    // rows[0] among all rows of the file. Rows are only valid during the call.
+    // Return false to stop reading.
+    typedef std::function<bool (const char (*rows)[vector_max_len], int count, int vector_length, long first_row)> Batch_fn;
+
+    // threads = 0 uses every hardware thread
+    Intellino_csv_reader(int batch_rows = 1024, int threads = 0);
+
+    // added to every value (wrapping like the old (char)atoi(tok) + offset)
+    void set_value_offset (int offset) { value_offset = offset; }
+    // stop after max_rows rows, < 0 reads the whole file
+    void set_max_rows (long rows) { max_rows = rows; }
+
+    // read() failures
+    static const long read_error = -1;     // the file can't be opened or mapped, errno is set
+    static const long format_error = -2;   // a line has more than vector_max_len values
+
+    // rows delivered, or read_error / format_error (the line is reported on stderr).
+    // Lines with fewer than min_vector_len values or a field that isn't a number of at
+    // most max_digits digits are skipped, each with a warning on stderr.
+    long read (const char* path, const Batch_fn& on_batch);
+
+    struct Chunk{
+        const char* begin;
+        const char* end;
+        std::vector<char> rows;        // count x vector_max_len
+        std::vector<uint8_t> lengths;  // values per row
+        long lines = 0;
+        long error_line = -1;          // line within the chunk, 1-based
+        int error_values = 0;
+        struct Skipped{
+            long line;                 // within the chunk, 1-based
+            int values;                // -1 for a field that isn't a number
+            long row;                  // rows of the chunk before it
+        };
+        std::vector<Skipped> skipped;
+    };
+
+private:
+    int batch_rows;
+    int threads;
+    int value_offset = 0;
+    long max_rows = -1;
+};
+
+#endif
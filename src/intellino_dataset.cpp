@@ -0,0 +1,141 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "intellino_dataset.h"
+
+static_assert(sizeof(Intellino_dataset_header) == 64, "dataset header must stay 64 bytes");
+
+// -------------------
+// reader
+// -------------------
+Intellino_dataset::~Intellino_dataset(){
+	close();
+}
+
+bool Intellino_dataset::open (const char* path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Intellino_dataset_header)) {
+		::close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+	madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+	// count <= INT_MAX keeps both products far below 2^64; the offsets are compared
+	// against the size before anything is added to them
+	const Intellino_dataset_header* h = (const Intellino_dataset_header*)mapped;
+	size_t size = st.st_size;
+	bool valid = memcmp(h->magic, INTELLINO_DATASET_MAGIC, sizeof(h->magic)) == 0
+		&& h->version == INTELLINO_DATASET_VERSION
+		&& h->row_stride == vector_max_len
+		&& h->vector_length > 0 && h->vector_length <= vector_max_len
+		&& h->count <= INT_MAX
+		&& h->rows_offset >= sizeof(Intellino_dataset_header)
+		&& h->rows_offset <= size && h->count*h->row_stride <= size - h->rows_offset
+		&& (!(h->flags & INTELLINO_DATASET_LABELS)
+			|| (h->labels_offset <= size && h->count*sizeof(uint16_t) <= size - h->labels_offset));
+	if (!valid) {
+		munmap(mapped, size);
+		return false;
+	}
+
+	map = mapped;
+	map_len = size;
+	header = h;
+	return true;
+}
+
+void Intellino_dataset::close ()
+{
+	if (map != nullptr)
+		munmap(map, map_len);
+	map = nullptr;
+	map_len = 0;
+	header = nullptr;
+}
+
+// -------------------
+// writer
+// -------------------
+Intellino_dataset_writer::~Intellino_dataset_writer(){
+	if (fp != NULL)
+		fclose(fp);
+	free(labels);
+}
+
+bool Intellino_dataset_writer::create (const char* path, int vector_length, bool labeled, int value_offset)
+{
+	if (vector_length <= 0 || vector_length > Intellino_dataset::vector_max_len)
+		return false;
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+	this->vector_length = vector_length;
+	this->labeled = labeled;
+	this->value_offset = value_offset;
+	count = 0;
+
+	// placeholder, finish() rewrites it with the final count
+	Intellino_dataset_header header = {};
+	return fwrite(&header, sizeof(header), 1, fp) == 1;
+}
+
+bool Intellino_dataset_writer::append (const char* vector, uint16_t label)
+{
+	char row[Intellino_dataset::vector_max_len] = {0};
+	memcpy(row, vector, vector_length);
+	if (fwrite(row, sizeof(row), 1, fp) != 1)
+		return false;
+
+	if (labeled) {
+		if (count == labels_reserved) {
+			labels_reserved = labels_reserved ? labels_reserved*2 : 1024;
+			uint16_t* grown = (uint16_t*)realloc(labels, labels_reserved*sizeof(uint16_t));
+			if (grown == NULL)
+				return false;
+			labels = grown;
+		}
+		labels[count] = label;
+	}
+	count++;
+	return true;
+}
+
+bool Intellino_dataset_writer::finish ()
+{
+	Intellino_dataset_header header = {};
+	memcpy(header.magic, INTELLINO_DATASET_MAGIC, sizeof(header.magic));
+	header.version = INTELLINO_DATASET_VERSION;
+	header.flags = labeled ? INTELLINO_DATASET_LABELS : 0;
+	header.vector_length = vector_length;
+	header.row_stride = Intellino_dataset::vector_max_len;
+	header.count = count;
+	header.rows_offset = sizeof(Intellino_dataset_header);
+	header.labels_offset = labeled ? header.rows_offset + count*header.row_stride : 0;
+	header.value_offset = value_offset;
+
+	bool ok = true;
+	if (labeled && count > 0)
+		ok = fwrite(labels, sizeof(uint16_t), count, fp) == count;
+	ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = (fclose(fp) == 0) && ok;
+	fp = NULL;
+	return ok;
+}
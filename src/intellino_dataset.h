@@ -0,0 +1,83 @@
+#ifndef INTELLINO_DATASET_H
+#define INTELLINO_DATASET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary descriptor dataset (*.bin), little endian:
+//   header (64 bytes)     Intellino_dataset_header
+//   rows                  count x row_stride bytes, zero padded, starts at rows_offset
+//   labels (optional)     count x uint16_t, starts at labels_offset
+// row_stride is Intellino_spi::vector_max_len, so the mapped rows can be handed to
+// classify_multi() as char[][vector_max_len] without copying. value_offset is what the
+// writer added to every CSV value (mod 256, as Intellino_csv_reader::set_value_offset).
+#define INTELLINO_DATASET_MAGIC		"INTLDSET"
+#define INTELLINO_DATASET_VERSION	1
+#define INTELLINO_DATASET_LABELS	0x1
+
+struct Intellino_dataset_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vector_length;
+    uint32_t row_stride;
+    uint64_t count;
+    uint64_t rows_offset;
+    uint64_t labels_offset;
+    int32_t value_offset;
+    uint8_t reserved[12];
+};
+
+// Read-only mmap of a *.bin dataset
+class Intellino_dataset{
+private:
+    void* map = nullptr;
+    size_t map_len = 0;
+    const Intellino_dataset_header* header = nullptr;
+
+public:
+    static const int vector_max_len = 64;
+
+    Intellino_dataset() {}
+    ~Intellino_dataset();
+    Intellino_dataset(const Intellino_dataset&) = delete;
+    Intellino_dataset& operator=(const Intellino_dataset&) = delete;
+
+    // false if the file is missing, not a dataset, truncated or holds more than INT_MAX rows
+    bool open (const char* path);
+    void close ();
+
+    int size () const { return header ? (int)header->count : 0; }
+    int vector_length () const { return header ? (int)header->vector_length : 0; }
+    int value_offset () const { return header ? header->value_offset : 0; }
+    bool has_labels () const { return header && (header->flags & INTELLINO_DATASET_LABELS); }
+    const char (*rows () const)[vector_max_len] { return (const char (*)[vector_max_len])((const char*)map + header->rows_offset); }
+    const char* row (int index) const { return rows()[index]; }
+    const uint16_t* labels () const { return has_labels() ? (const uint16_t*)((const char*)map + header->labels_offset) : nullptr; }
+};
+
+// Streaming writer, rows first, labels and header are written by finish()
+class Intellino_dataset_writer{
+private:
+    FILE* fp = nullptr;
+    int vector_length = 0;
+    int value_offset = 0;
+    uint64_t count = 0;
+    bool labeled = false;
+    uint16_t* labels = nullptr;
+    size_t labels_reserved = 0;
+
+public:
+    Intellino_dataset_writer() {}
+    ~Intellino_dataset_writer();
+    Intellino_dataset_writer(const Intellino_dataset_writer&) = delete;
+    Intellino_dataset_writer& operator=(const Intellino_dataset_writer&) = delete;
+
+    // value_offset: recorded in the header, the vectors passed to append() already carry it
+    bool create (const char* path, int vector_length, bool labeled, int value_offset = 0);
+    bool append (const char* vector, uint16_t label);
+    bool finish ();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <string.h>
+#include "intellino_emulator.h"
+
+Intellino_emulator::Intellino_emulator(int neuron_capacity)
+	: neurons(neuron_capacity)
+{
+}
+
+// Only runs once a READ follows a READ_CATEGORY, so plain classify frames never pay
+// for it. Ranks twice as many winners as read so far: k reads cost O(log k) scans.
+void Intellino_emulator::rank_winner ()
+{
+	if (winner >= (int)winner_distance.size()) {
+		int k = 2*(winner + 1) > 8 ? 2*(winner + 1) : 8;
+		winner_distance.resize(k);
+		winner_category.resize(k);
+		neurons.classify_topk(query_len, query, k, winner_distance.data(), winner_category.data());
+	}
+	distance = winner_distance[winner];
+	category = winner_category[winner];
+}
+
+// ------------------------------
+// byte stream decoder (MOSI -> MISO)
+// ------------------------------
+// READ_DISTANCE / READ_CATEGORY answer on the 2nd and 3rd byte after the command:
+//   tx : 0x83 0x00 0x00 0x00
+//   rx : ---- 0x00 [hi] [lo]
+void Intellino_emulator::transfer(char* tx, char* rx, int len)
+{
+	message_count++;
+	const uint8_t* in = (const uint8_t*)tx;
+	uint8_t* out = (uint8_t*)rx;
+	int i = 0;
+
+	while (i < len) {
+		switch (state) {
+			case IDLE		:	out[i] = DUMMY;
+							command = in[i++];
+							if (command == LEARN_COMMAND || command == CLASSIFY_COMMAND) {
+								state = LENGTH_HI;
+							} else if (command == READ_DISTANCE || command == READ_CATEGORY) {
+								if (winner > 0)
+									rank_winner();
+								reply_value = (command == READ_DISTANCE) ? distance : category;
+								reply_pos = 0;
+								state = REPLY;
+							}
+							break;
+			case LENGTH_HI		:	out[i] = DUMMY;
+							payload_len = in[i++] << 8;
+							state = LENGTH_LO;
+							break;
+			case LENGTH_LO		:	out[i] = DUMMY;
+							payload_len = (payload_len | in[i++]) + 1;
+							payload_pos = 0;
+							state = PAYLOAD;
+							break;
+			case PAYLOAD		: {
+							int n = payload_len - payload_pos;
+							if (n > len - i)
+								n = len - i;
+							if (payload_pos < Intellino_knn::vector_max_len) {
+								int stored = Intellino_knn::vector_max_len - payload_pos;
+								memcpy(payload + payload_pos, in + i, n < stored ? n : stored);
+							}
+							memset(out + i, DUMMY, n);
+							i += n;
+							payload_pos += n;
+							if (payload_pos == payload_len) {
+								if (command == LEARN_COMMAND) {
+									state = CATEGORY;
+								} else {
+									neurons.classify(stored_len(), payload, &distance, &category);
+									query_len = stored_len();
+									memcpy(query, payload, query_len);
+									winner = 0;
+									winner_distance.clear();
+									winner_category.clear();
+									state = IDLE;
+								}
+							}
+							break;
+						}
+			case CATEGORY		:	out[i] = DUMMY;
+							neurons.learn(stored_len(), payload, in[i++]);
+							state = IDLE;
+							break;
+			case REPLY		:	out[i] = (reply_pos == 0) ? DUMMY
+								: (reply_pos == 1) ? (uint8_t)(reply_value >> 8)
+								: (uint8_t)(reply_value & 0x00FF);
+							i++;
+							if (++reply_pos == 3) {
+								if (command == READ_CATEGORY)
+									winner++;
+								state = IDLE;
+							}
+							break;
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef INTELLINO_EMULATOR_H
+#define INTELLINO_EMULATOR_H
+
+#include <stdint.h>
+#include <vector>
+#include "intellino_transport.h"
+#include "intellino_knn.h"
+
+// Software Intellino. Decodes the LEARN / CLASSIFY / READ_DISTANCE / READ_CATEGORY
+// byte stream exactly as the chip sees it on MOSI and answers on MISO, so the
+// Intellino_spi frame code runs unchanged on hosts without a board.
+// Frames may be split across transfer() calls; the decoder keeps its state.
+// Each READ_CATEGORY moves on to the next closest neuron, so repeated READ_DISTANCE /
+// READ_CATEGORY pairs after one CLASSIFY return the winners in order (top-k).
+class Intellino_emulator : public Intellino_transport{
+private:
+    enum State { IDLE, LENGTH_HI, LENGTH_LO, PAYLOAD, CATEGORY, REPLY };
+
+    Intellino_knn neurons;
+    State state = IDLE;
+    uint8_t command = 0;
+    int payload_len = 0;
+    int payload_pos = 0;
+    alignas(64) uint8_t payload[Intellino_knn::vector_max_len];
+    int distance = Intellino_knn::max_distance;
+    int category = 0;
+    int reply_pos = 0;
+    int reply_value = 0;
+
+    // winners of the last CLASSIFY beyond the first, ranked on demand
+    alignas(64) uint8_t query[Intellino_knn::vector_max_len];
+    int query_len = 0;
+    int winner = 0;
+    std::vector<int> winner_distance;
+    std::vector<int> winner_category;
+    void rank_winner ();
+
+    uint32_t clock_hz = 0;
+
+    int stored_len() const { return payload_len < Intellino_knn::vector_max_len ? payload_len : Intellino_knn::vector_max_len; }
+
+public:
+    Intellino_emulator(int neuron_capacity = 0);
+    void transfer(char* tx, char* rx, int len);
+    bool repeated_reads() const { return true; }
+    // no wire: any clock is accepted and changes nothing
+    uint32_t speed_hz() const { return clock_hz; }
+    bool set_speed_hz(uint32_t hz) { clock_hz = hz; return true; }
+    int learned() const { return neurons.size(); }
+};
+
+#endif
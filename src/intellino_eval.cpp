@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "intellino_eval.h"
+
+Intellino_evaluation::Intellino_evaluation(){
+	matrix = new uint32_t[categories*categories]();
+}
+
+Intellino_evaluation::~Intellino_evaluation(){
+	delete[] matrix;
+}
+
+// -------------------
+// accumulate
+// -------------------
+void Intellino_evaluation::add (int expected, int distance, int category)
+{
+	total++;
+	if (category == Intellino_knn::unknown_category) {
+		reject_total++;
+		if (expected >= 0)
+			labeled_total++;
+		return;
+	}
+	if (distance >= Intellino_knn::max_distance) {
+		no_match++;
+		if (expected >= 0)
+			labeled_total++;
+		return;
+	}
+	bool wrong = false;
+	if (category >= 0 && category < categories)
+		predicted_total[category]++;
+	if (expected >= 0) {
+		labeled_total++;
+		wrong = expected != category;
+		if (!wrong)
+			correct_total++;
+		if (expected < categories && category >= 0 && category < categories)
+			matrix[expected*categories + category]++;
+	}
+	int bucket = distance / bucket_width;
+	if (bucket >= distance_buckets)
+		bucket = distance_buckets - 1;
+	distances[bucket]++;
+	distance_sum += distance;
+	if (distance > distance_max)
+		distance_max = distance;
+	if (wrong) {
+		wrong_distances[bucket]++;
+		if (distance > distance_wrong_max)
+			distance_wrong_max = distance;
+	}
+}
+
+void Intellino_evaluation::add_batch (int multi_dataset_num, const uint16_t* labels, const int *distance, const int *category)
+{
+	for (int j=0; j<multi_dataset_num; j++)
+		add(labels ? labels[j] : -1, distance[j], category[j]);
+}
+
+void Intellino_evaluation::add (const Intellino_evaluation& other)
+{
+	total += other.total;
+	labeled_total += other.labeled_total;
+	correct_total += other.correct_total;
+	no_match += other.no_match;
+	reject_total += other.reject_total;
+	distance_sum += other.distance_sum;
+	if (other.distance_max > distance_max)
+		distance_max = other.distance_max;
+	if (other.distance_wrong_max > distance_wrong_max)
+		distance_wrong_max = other.distance_wrong_max;
+	for (int i=0; i<categories; i++)
+		predicted_total[i] += other.predicted_total[i];
+	for (int i=0; i<distance_buckets; i++) {
+		distances[i] += other.distances[i];
+		wrong_distances[i] += other.wrong_distances[i];
+	}
+	for (int i=0; i<categories*categories; i++)
+		matrix[i] += other.matrix[i];
+}
+
+void Intellino_evaluation::reset ()
+{
+	total = labeled_total = correct_total = no_match = reject_total = distance_sum = 0;
+	distance_max = distance_wrong_max = 0;
+	memset(predicted_total, 0, sizeof(predicted_total));
+	memset(distances, 0, sizeof(distances));
+	memset(wrong_distances, 0, sizeof(wrong_distances));
+	memset(matrix, 0, sizeof(uint32_t)*categories*categories);
+}
+
+// -------------------
+// report
+// -------------------
+double Intellino_evaluation::mean_distance () const
+{
+	long matched = total - no_match - reject_total;
+	return matched ? (double)distance_sum / matched : 0;
+}
+
+int Intellino_evaluation::distance_percentile (double q, bool wrong_only) const
+{
+	const long* counts = wrong_only ? wrong_distances : distances;
+	int max = wrong_only ? distance_wrong_max : distance_max;
+	long n = 0;
+	for (int i=0; i<distance_buckets; i++)
+		n += counts[i];
+	if (n == 0)
+		return 0;
+	long rank = (long)(q*n + 0.5);
+	if (rank < 1)
+		rank = 1;
+	long seen = 0;
+	for (int i=0; i<distance_buckets; i++) {
+		seen += counts[i];
+		if (seen >= rank) {
+			int edge = (i + 1)*bucket_width - 1;
+			return edge < max ? edge : max;
+		}
+	}
+	return max;
+}
+
+void Intellino_evaluation::print_summary (FILE* fp, int worst) const
+{
+	int answered = 0;
+	for (int i=0; i<categories; i++)
+		answered += predicted_total[i] != 0;
+	if (labeled_total)
+		fprintf(fp, "eval: %ld queries, accuracy %.2f%% (%ld of %ld labeled), %ld unmatched, %ld rejected, %d categories answered\n",
+			total, 100 * accuracy(), correct_total, labeled_total, no_match, reject_total, answered);
+	else
+		fprintf(fp, "eval: %ld queries, no labels, %ld unmatched, %ld rejected, %d categories answered\n",
+			total, no_match, reject_total, answered);
+	fprintf(fp, "eval: distance mean %.1f, p50 %d, p90 %d, p99 %d, max %d\n",
+		mean_distance(), distance_percentile(0.5), distance_percentile(0.9), distance_percentile(0.99), distance_max);
+	long wrong = 0;
+	for (int i=0; i<distance_buckets; i++)
+		wrong += wrong_distances[i];
+	if (wrong == 0)
+		return;
+	fprintf(fp, "eval: wrong answers distance p10 %d, p50 %d, max %d\n",
+		distance_percentile(0.1, true), distance_percentile(0.5, true), distance_wrong_max);
+
+	// the largest off-diagonal cells, a small insertion-sorted list
+	std::vector<int> top;
+	for (int cell=0; cell<categories*categories; cell++) {
+		if (matrix[cell] == 0 || cell / categories == cell % categories)
+			continue;
+		size_t at = top.size();
+		while (at > 0 && matrix[top[at-1]] < matrix[cell])
+			at--;
+		if ((int)at >= worst)
+			continue;
+		top.insert(top.begin() + at, cell);
+		if ((int)top.size() > worst)
+			top.pop_back();
+	}
+	if (top.empty())
+		return;
+	fprintf(fp, "eval: most confused (expected -> answered):");
+	for (int cell : top)
+		fprintf(fp, " %d->%d (%u)", cell / categories, cell % categories, matrix[cell]);
+	fputc('\n', fp);
+}
+
+void Intellino_evaluation::write_confusion_csv (FILE* fp) const
+{
+	fprintf(fp, "expected,predicted,count\n");
+	for (int cell=0; cell<categories*categories; cell++)
+		if (matrix[cell])
+			fprintf(fp, "%d,%d,%u\n", cell / categories, cell % categories, matrix[cell]);
+}
+
+// -------------------
+// parallel evaluation
+// -------------------
+// classify_chunk(first, count, distance, category) answers rows[first .. first+count)
+template <typename Classify_chunk>
+static void evaluate_chunks (int multi_dataset_num, const uint16_t* labels, Intellino_evaluation& result,
+			int threads, int chunk_rows, Classify_chunk classify_chunk)
+{
+	if (multi_dataset_num <= 0)
+		return;
+	if (chunk_rows < 1)
+		chunk_rows = 1024;
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	int chunks = (multi_dataset_num + chunk_rows - 1) / chunk_rows;
+	if (threads > chunks)
+		threads = chunks;
+	if (threads < 1)
+		threads = 1;
+
+	std::atomic<int> next{0};
+	std::vector<Intellino_evaluation*> partial(threads);
+	auto worker = [&](int t) {
+		Intellino_evaluation* own = t == 0 ? &result : new Intellino_evaluation;
+		partial[t] = own;
+		std::vector<int> distance(chunk_rows), category(chunk_rows);
+		for (int first; (first = next.fetch_add(chunk_rows)) < multi_dataset_num; ) {
+			int count = multi_dataset_num - first < chunk_rows ? multi_dataset_num - first : chunk_rows;
+			classify_chunk(first, count, distance.data(), category.data());
+			own->add_batch(count, labels ? labels + first : NULL, distance.data(), category.data());
+		}
+	};
+	std::vector<std::thread> pool;
+	for (int t=1; t<threads; t++)
+		pool.emplace_back(worker, t);
+	worker(0);
+	for (int t=1; t<threads; t++) {
+		pool[t-1].join();
+		result.add(*partial[t]);
+		delete partial[t];
+	}
+}
+
+void intellino_evaluate (Intellino_classifier& backend, int multi_dataset_num, int vector_length,
+			const char rows[][Intellino_classifier::vector_max_len], const uint16_t* labels,
+			Intellino_evaluation& result, int threads, int chunk_rows, int reject_distance)
+{
+	evaluate_chunks(multi_dataset_num, labels, result, threads, chunk_rows, [&](int first, int count, int *distance, int *category) {
+		if (reject_distance < 0)
+			backend.classify_multi(count, vector_length, rows + first, distance, category);
+		else
+			backend.classify_multi_within(reject_distance, count, vector_length, rows + first, distance, category);
+	});
+}
+
+void intellino_evaluate (const Intellino_knn& backend, int multi_dataset_num, int vector_length,
+			const char rows[][Intellino_knn::vector_max_len], const uint16_t* labels,
+			Intellino_evaluation& result, int threads, int chunk_rows, int reject_distance)
+{
+	evaluate_chunks(multi_dataset_num, labels, result, threads, chunk_rows, [&](int first, int count, int *distance, int *category) {
+		backend.classify_multi(count, vector_length, rows + first, distance, category, 1, reject_distance);
+	});
+}
@@ -0,0 +1,76 @@
+#ifndef INTELLINO_EVAL_H
+#define INTELLINO_EVAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "intellino_classifier.h"
+#include "intellino_knn.h"
+
+// Aggregated answers over a test set: accuracy against the labels (when there are any),
+// a confusion matrix over the 256 chip categories, and the distribution of the winning
+// distances, for all answers and for the wrong ones. Plain counters with no locking; each
+// thread fills its own and add() merges them.
+class Intellino_evaluation{
+public:
+    static const int categories = 256;
+    static const int bucket_width = 256;
+    static const int distance_buckets = 64;     // covers 255 * vector_max_len
+
+    Intellino_evaluation();
+    ~Intellino_evaluation();
+    Intellino_evaluation(const Intellino_evaluation&) = delete;
+    Intellino_evaluation& operator=(const Intellino_evaluation&) = delete;
+
+    // one answer; expected < 0 means unlabeled
+    void add (int expected, int distance, int category);
+    // labels may be null for an unlabeled batch
+    void add_batch (int multi_dataset_num, const uint16_t* labels, const int *distance, const int *category);
+    void add (const Intellino_evaluation& other);
+    void reset ();
+
+    long queries () const { return total; }
+    long labeled () const { return labeled_total; }
+    long correct () const { return correct_total; }
+    long unmatched () const { return no_match; }     // 0xFFFF answers, nothing learned
+    long rejected () const { return reject_total; }  // unknown_category, past the distance bound
+    double accuracy () const { return labeled_total ? (double)correct_total / labeled_total : 0; }
+    // [expected][predicted] over labeled answers with a label < categories
+    uint32_t confusion (int expected, int predicted) const { return matrix[expected*categories + predicted]; }
+    long predicted (int category) const { return predicted_total[category]; }
+    double mean_distance () const;
+    // q in [0, 1], upper edge of the bucket holding the rank (exact max for q = 1); unmatched answers excluded
+    int distance_percentile (double q, bool wrong_only = false) const;
+
+    // accuracy, distance percentiles and the most confused categories
+    void print_summary (FILE* fp, int worst = 5) const;
+    // non-zero confusion cells as "expected,predicted,count" lines
+    void write_confusion_csv (FILE* fp) const;
+
+private:
+    long total = 0;
+    long labeled_total = 0;
+    long correct_total = 0;
+    long no_match = 0;
+    long reject_total = 0;
+    long distance_sum = 0;
+    int distance_max = 0;
+    int distance_wrong_max = 0;
+    long predicted_total[categories] = {};
+    long distances[distance_buckets] = {};
+    long wrong_distances[distance_buckets] = {};
+    uint32_t* matrix;
+};
+
+// Classifies rows[0 .. multi_dataset_num) in chunks of chunk_rows, threads claiming chunks
+// from a shared atomic cursor and accumulating into their own Intellino_evaluation
+// (threads = 0 uses every hardware thread). A chip backend serializes the chunks on its
+// bus and the threads only overlap the bookkeeping; the host engine runs on every core.
+// reject_distance >= 0 classifies within that bound (classify_multi_within).
+void intellino_evaluate (Intellino_classifier& backend, int multi_dataset_num, int vector_length,
+            const char rows[][Intellino_classifier::vector_max_len], const uint16_t* labels,
+            Intellino_evaluation& result, int threads = 0, int chunk_rows = 1024, int reject_distance = -1);
+void intellino_evaluate (const Intellino_knn& backend, int multi_dataset_num, int vector_length,
+            const char rows[][Intellino_knn::vector_max_len], const uint16_t* labels,
+            Intellino_evaluation& result, int threads = 0, int chunk_rows = 1024, int reject_distance = -1);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "intellino_frame.h"
+
+Intellino_frame_arena::~Intellino_frame_arena(){
+	free(tx);
+	free(rx);
+}
+
+void Intellino_frame_arena::reserve (size_t bytes)
+{
+	if (bytes <= reserved)
+		return;
+
+	size_t grown = reserved ? reserved : 4096;
+	while (grown < bytes)
+		grown *= 2;
+
+	uint8_t* grown_tx = (uint8_t*)aligned_alloc(64, grown);
+	uint8_t* grown_rx = (uint8_t*)aligned_alloc(64, grown);
+	if (grown_tx == NULL || grown_rx == NULL)
+		abort();
+	// keep the frames already laid out, only the tail needs headers
+	if (layout_frames)
+		memcpy(grown_tx, tx, reserved);
+	free(tx);
+	free(rx);
+	tx = grown_tx;
+	rx = grown_rx;
+	reserved = grown;
+}
+
+void Intellino_frame_arena::layout (int command, int vector_length, int reads, int frames)
+{
+	if (command != layout_command || vector_length != layout_vector_length || reads != layout_reads) {
+		layout_command = command;
+		layout_vector_length = vector_length;
+		layout_reads = reads;
+		layout_frames = 0;
+	}
+	if (frames <= layout_frames)
+		return;
+
+	int frame_len = (command == LEARN_COMMAND) ? learn_frame_len(vector_length) : classify_frame_len(vector_length, reads);
+	reserve((size_t)frame_len*frames);
+
+	std::vector<uint8_t> frame_template(frame_len, 0);
+	frame_template[0] = (uint8_t)command;
+	frame_template[1] = (uint8_t)((vector_length-1) >> 8);
+	frame_template[2] = (uint8_t)((vector_length-1) & 0x00FF);
+	if (command == CLASSIFY_COMMAND) {
+		for (int r=0; r<reads; r++) {
+			frame_template[vector_length+3+8*r] = READ_DISTANCE;
+			frame_template[vector_length+7+8*r] = READ_CATEGORY;
+		}
+	}
+
+	for (int j=layout_frames; j<frames; j++)
+		memcpy(tx + (size_t)frame_len*j, frame_template.data(), frame_len);
+	layout_frames = frames;
+}
+
+int Intellino_frame_arena::lay_out_from (int command, int vector_length, int reads, int frames, int frame_len)
+{
+	if (command != layout_command || vector_length != layout_vector_length || reads != layout_reads) {
+		layout_command = command;
+		layout_vector_length = vector_length;
+		layout_reads = reads;
+		layout_frames = 0;
+	}
+	int fresh = layout_frames;
+	if (frames > layout_frames) {
+		reserve((size_t)frame_len*frames);
+		layout_frames = frames;
+	}
+	return fresh;
+}
+
+int Intellino_frame_arena::encode_learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	layout(LEARN_COMMAND, vector_length, 0, 1);
+	memcpy(tx + 3, learn_data, vector_length);
+	tx[vector_length+3] = learn_category;
+	return learn_frame_len(vector_length);
+}
+
+int Intellino_frame_arena::encode_learn_multi (int multi_dataset_num, int vector_length, const char (*learn_multi_data)[vector_max_len],
+					const uint8_t* learn_multi_category)
+{
+	int frame_len = learn_frame_len(vector_length);
+	layout(LEARN_COMMAND, vector_length, 0, multi_dataset_num);
+	uint8_t* frame = tx + 3;
+	for (int j=0; j<multi_dataset_num; j++, frame += frame_len) {
+		memcpy(frame, learn_multi_data[j], vector_length);
+		frame[vector_length] = learn_multi_category[j];
+	}
+	return frame_len*multi_dataset_num;
+}
+
+int Intellino_frame_arena::encode_classify (int multi_dataset_num, int vector_length, const char (*test_multi_data)[vector_max_len], int reads)
+{
+	int frame_len = classify_frame_len(vector_length, reads);
+	layout(CLASSIFY_COMMAND, vector_length, reads, multi_dataset_num);
+	uint8_t* frame = tx + 3;
+	for (int j=0; j<multi_dataset_num; j++, frame += frame_len)
+		memcpy(frame, test_multi_data[j], vector_length);
+	return frame_len*multi_dataset_num;
+}
@@ -0,0 +1,134 @@
+#ifndef INTELLINO_FRAME_H
+#define INTELLINO_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include "intellino_transport.h"
+
+// LEARN    : [0x60][len-1 hi][len-1 lo][payload ...][category]
+// CLASSIFY : [0x40][len-1 hi][len-1 lo][payload ...][0x83 0 0 0][0x84 0 0 0]
+//            distance comes back on rx[len+5..len+6], category on rx[len+9..len+10]
+// Top-k CLASSIFY repeats the 8 READ bytes k times; pair r carries the (r+1)-th winner.
+inline int learn_frame_len (int vector_length) { return vector_length + 4; }
+inline int classify_frame_len (int vector_length, int reads = 1) { return vector_length + 3 + 8*reads; }
+inline int classify_distance_offset (int vector_length, int rank = 0) { return vector_length + 5 + 8*rank; }
+inline int classify_category_offset (int vector_length, int rank = 0) { return vector_length + 9 + 8*rank; }
+
+inline int decode_u16 (const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+// The same layout fixed at compile time for an N-byte payload: frame lengths, offsets,
+// the command header and the READ trailer are constants.
+template <int N, int Reads = 1>
+struct Intellino_frame_layout{
+    static_assert(N >= 1 && N <= 0x10000, "payload length must fit the len-1 field");
+
+    static constexpr int learn_len = N + 4;
+    static constexpr int classify_len = N + 3 + 8*Reads;
+    static constexpr int distance_offset (int rank = 0) { return N + 5 + 8*rank; }
+    static constexpr int category_offset (int rank = 0) { return N + 9 + 8*rank; }
+
+    static constexpr std::array<uint8_t, 3> header (uint8_t command)
+    {
+        return {command, (uint8_t)((N-1) >> 8), (uint8_t)((N-1) & 0x00FF)};
+    }
+    static constexpr std::array<uint8_t, 8*Reads> trailer ()
+    {
+        std::array<uint8_t, 8*Reads> bytes{};
+        for (int r=0; r<Reads; r++) {
+            bytes[8*r] = READ_DISTANCE;
+            bytes[8*r+4] = READ_CATEGORY;
+        }
+        return bytes;
+    }
+};
+
+// distances / categories of `frames` CLASSIFY frames laid out back to back in rx
+template <int N>
+inline void decode_classify_fixed (const uint8_t* rx, int frames, int* distance, int* category)
+{
+    typedef Intellino_frame_layout<N> frame;
+    for (int j=0; j<frames; j++, rx += frame::classify_len) {
+        distance[j] = decode_u16(rx + frame::distance_offset());
+        category[j] = decode_u16(rx + frame::category_offset());
+    }
+}
+
+// Reusable, 64-byte aligned tx/rx buffers for a run of same-length frames.
+// The command header and READ trailers are laid out once per (command, vector_length)
+// and stay valid across calls, so encoding a batch is one memcpy per payload.
+class Intellino_frame_arena{
+private:
+    uint8_t* tx = nullptr;
+    uint8_t* rx = nullptr;
+    size_t reserved = 0;
+    int layout_command = -1;
+    int layout_vector_length = 0;
+    int layout_reads = 0;
+    int layout_frames = 0;
+
+    void reserve (size_t bytes);
+    void layout (int command, int vector_length, int reads, int frames);
+    // for encoders that lay out frames themselves: reserves frames, records them as laid
+    // out and returns the first one that still needs its header and trailer
+    int lay_out_from (int command, int vector_length, int reads, int frames, int frame_len);
+
+public:
+    static const int vector_max_len = 64;
+
+    Intellino_frame_arena() {}
+    ~Intellino_frame_arena();
+    Intellino_frame_arena(const Intellino_frame_arena&) = delete;
+    Intellino_frame_arena& operator=(const Intellino_frame_arena&) = delete;
+
+    // both return the number of bytes to transfer; frames start at tx_buf().
+    // vector_length must be 1 .. vector_max_len (Intellino_spi checks it).
+    int encode_learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    int encode_learn_multi (int multi_dataset_num, int vector_length, const char (*learn_multi_data)[vector_max_len],
+                const uint8_t* learn_multi_category);
+    // reads = READ_DISTANCE / READ_CATEGORY pairs per frame (k for top-k)
+    int encode_classify (int multi_dataset_num, int vector_length, const char (*test_multi_data)[vector_max_len], int reads = 1);
+
+    // N-byte payloads from rows stride bytes apart: every store has a constant size and
+    // offset, so the copies unroll; same frames as the runtime-length encoders
+    template <int N>
+    int encode_learn_fixed (int multi_dataset_num, const uint8_t* rows, size_t stride, const uint8_t* categories)
+    {
+        typedef Intellino_frame_layout<N> frame;
+        static constexpr std::array<uint8_t, 3> header = frame::header(LEARN_COMMAND);
+        int fresh = lay_out_from(LEARN_COMMAND, N, 0, multi_dataset_num, frame::learn_len);
+        uint8_t* out = tx;
+        for (int j=0; j<multi_dataset_num; j++, out += frame::learn_len, rows += stride) {
+            if (j >= fresh)
+                memcpy(out, header.data(), header.size());
+            memcpy(out + 3, rows, N);
+            out[N+3] = categories[j];
+        }
+        return frame::learn_len*multi_dataset_num;
+    }
+
+    template <int N>
+    int encode_classify_fixed (int multi_dataset_num, const uint8_t* rows, size_t stride)
+    {
+        typedef Intellino_frame_layout<N> frame;
+        static constexpr std::array<uint8_t, 3> header = frame::header(CLASSIFY_COMMAND);
+        static constexpr std::array<uint8_t, 8> trailer = frame::trailer();
+        int fresh = lay_out_from(CLASSIFY_COMMAND, N, 1, multi_dataset_num, frame::classify_len);
+        uint8_t* out = tx;
+        for (int j=0; j<multi_dataset_num; j++, out += frame::classify_len, rows += stride) {
+            memcpy(out + 3, rows, N);
+            if (j >= fresh) {
+                memcpy(out, header.data(), header.size());
+                memcpy(out + 3 + N, trailer.data(), trailer.size());
+            }
+        }
+        return frame::classify_len*multi_dataset_num;
+    }
+
+    char* tx_buf() { return (char*)tx; }
+    char* rx_buf() { return (char*)rx; }
+    const uint8_t* rx_frame (int frame_len, int index) const { return rx + (size_t)frame_len*index; }
+};
+
+#endif
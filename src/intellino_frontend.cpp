@@ -0,0 +1,342 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "intellino_frontend.h"
+
+// -------------------
+// MPSC queue
+// -------------------
+void Intellino_mpsc_queue::push (Intellino_mpsc_node* node)
+{
+	node->next.store(nullptr, std::memory_order_relaxed);
+	Intellino_mpsc_node* prev = head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+Intellino_mpsc_node* Intellino_mpsc_queue::pop ()
+{
+	Intellino_mpsc_node* node = tail;
+	Intellino_mpsc_node* next = node->next.load(std::memory_order_acquire);
+	if (node == &stub) {
+		if (next == nullptr)
+			return nullptr;
+		tail = next;
+		node = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+	if (next != nullptr) {
+		tail = next;
+		return node;
+	}
+	// node is the last one; a producer may be between its exchange and its store
+	if (node != head.load(std::memory_order_acquire))
+		return nullptr;
+	push(&stub);
+	next = node->next.load(std::memory_order_acquire);
+	if (next != nullptr) {
+		tail = next;
+		return node;
+	}
+	return nullptr;
+}
+
+// -------------------
+// Intellino_frontend
+// -------------------
+Intellino_frontend::Intellino_frontend(Intellino_classifier* chip, const Intellino_batch_policy& policy){
+	this->chip = chip;
+	this->policy = policy;
+	if (this->policy.max_batch <= 0)
+		this->policy.max_batch = 4096;
+	if (this->policy.max_delay_us < 0)
+		this->policy.max_delay_us = 0;
+	target = this->policy.max_batch;
+	wait_ns = this->policy.max_delay_us*1000L;
+	bus_thread = std::thread(&Intellino_frontend::bus_loop, this);
+}
+
+Intellino_frontend::~Intellino_frontend(){
+	stop_async();
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		stopping = true;
+	}
+	wake_cv.notify_one();
+	bus_thread.join();
+	delete chip;
+}
+
+// pending is raised before the push, so the bus thread never sleeps on a queued request
+std::future<void> Intellino_frontend::enqueue (Request* request)
+{
+	std::future<void> done = request->done.get_future();
+	request->queued = clock::now();
+	pending.fetch_add(1);
+	queue.push(request);
+	if (sleeping.load()) {
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		wake_cv.notify_one();
+	}
+	return done;
+}
+
+Intellino_frontend::Request* Intellino_frontend::next_request ()
+{
+	if (carried != nullptr) {
+		Request* request = carried;
+		carried = nullptr;
+		return request;
+	}
+	while (pending.load() > 0) {
+		Intellino_mpsc_node* node = queue.pop();
+		if (node != nullptr) {
+			pending.fetch_sub(1);
+			return static_cast<Request*>(node);
+		}
+		std::this_thread::yield();
+	}
+	return nullptr;
+}
+
+// The promise is moved out first: once it is set the caller may return and free the request.
+static void complete (std::promise<void>& done)
+{
+	std::promise<void> ready = std::move(done);
+	ready.set_value();
+}
+
+void Intellino_frontend::run (Request* request)
+{
+	switch (request->kind) {
+		case LEARN		:	chip->learn(request->vector_length, request->data[0], request->categories[0]);
+						break;
+		case LEARN_MULTI	:	chip->learn_multi(request->multi_dataset_num, request->vector_length, request->data, request->categories);
+						break;
+		case CLASSIFY_MULTI	:	{
+							clock::time_point start = clock::now();
+							chip->classify_multi(request->multi_dataset_num, request->vector_length, request->data,
+										request->distance, request->category);
+							tune(request->multi_dataset_num, clock::now() - start);
+							requests++;
+							batches++;
+						}
+						break;
+		case CLASSIFY_TOPK	:	chip->classify_topk(request->multi_dataset_num, request->vector_length, request->data, request->k,
+									request->distance, request->category);
+						break;
+	}
+	bool owned = request->owned;
+	complete(request->done);
+	if (owned)
+		delete request;
+}
+
+// one classify_multi for every request in batch, answers scattered back per request
+void Intellino_frontend::run_batch ()
+{
+	if (batch.size() == 1) {
+		run(batch[0]);
+		return;
+	}
+
+	int vector_length = batch[0]->vector_length;
+	int total = 0;
+	for (Request* request : batch)
+		total += request->multi_dataset_num;
+	if (batch_rows.size() < (size_t)total*vector_max_len) {
+		batch_rows.resize((size_t)total*vector_max_len);
+		batch_distance.resize(total);
+		batch_category.resize(total);
+	}
+	char (*rows)[vector_max_len] = (char (*)[vector_max_len])batch_rows.data();
+	int first = 0;
+	for (Request* request : batch) {
+		memcpy(rows[first], request->data, (size_t)request->multi_dataset_num*vector_max_len);
+		first += request->multi_dataset_num;
+	}
+
+	clock::time_point start = clock::now();
+	chip->classify_multi(total, vector_length, rows, batch_distance.data(), batch_category.data());
+	tune(total, clock::now() - start);
+	batches++;
+
+	first = 0;
+	for (Request* request : batch) {
+		int n = request->multi_dataset_num;
+		memcpy(request->distance, &batch_distance[first], sizeof(int)*n);
+		memcpy(request->category, &batch_category[first], sizeof(int)*n);
+		first += n;
+		requests++;
+		bool owned = request->owned;
+		complete(request->done);
+		if (owned)
+			delete request;
+	}
+}
+
+// target_batch settles where one batch keeps the bus busy for about max_delay_us:
+// at n vectors a call costs fixed + n*per_vector, so n = max_delay / (latency / n) converges
+// to (max_delay - fixed) / per_vector.
+void Intellino_frontend::tune (int vectors, clock::duration latency)
+{
+	if (!policy.auto_tune || policy.max_delay_us == 0 || vectors <= 0)
+		return;
+	double ns = std::chrono::duration<double, std::nano>(latency).count() / vectors;
+	ns_per_vector = ns_per_vector > 0 ? 0.875*ns_per_vector + 0.125*ns : ns;
+	double fit = policy.max_delay_us*1000.0 / (ns_per_vector > 1 ? ns_per_vector : 1);
+	target = fit < 1 ? 1 : fit > policy.max_batch ? policy.max_batch : (int)fit;
+}
+
+void Intellino_frontend::bus_loop ()
+{
+	while (true) {
+		Request* request = next_request();
+		if (request == nullptr) {
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			if (stopping && pending.load() == 0)
+				return;
+			sleeping = true;
+			wake_cv.wait(lock, [this]{ return pending.load() > 0 || stopping; });
+			sleeping = false;
+			continue;
+		}
+		if (request->kind != CLASSIFY_MULTI) {
+			run(request);
+			continue;
+		}
+
+		// coalesce what is queued behind it, then wait for more until the batch reaches
+		// the target or the oldest request reaches its deadline
+		batch.clear();
+		batch.push_back(request);
+		int total = request->multi_dataset_num;
+		int limit = target;
+		long wait = wait_ns;
+		clock::time_point deadline = request->queued + std::chrono::nanoseconds(wait);
+		size_t before_wait = 0;
+		bool expired = false;
+		while (total < limit) {
+			Request* next = next_request();
+			if (next == nullptr) {
+				if (wait == 0 || stopping)
+					break;
+				if (clock::now() >= deadline) {
+					expired = true;
+					break;
+				}
+				if (before_wait == 0)
+					before_wait = batch.size();
+				std::unique_lock<std::mutex> lock(wake_mutex);
+				sleeping = true;
+				wake_cv.wait_until(lock, deadline, [this]{ return pending.load() > 0 || stopping; });
+				sleeping = false;
+				continue;
+			}
+			if (next->kind != CLASSIFY_MULTI || next->vector_length != request->vector_length
+					|| total + next->multi_dataset_num > policy.max_batch) {
+				carried = next;
+				break;
+			}
+			batch.push_back(next);
+			total += next->multi_dataset_num;
+		}
+		if (total >= limit)
+			flushed_full++;
+		else if (expired)
+			flushed_deadline++;
+
+		// a wait that filled the batch doubles, one that ran out halves; with no wait left,
+		// requests that coalesce anyway start a short one again
+		if (policy.auto_tune && policy.max_delay_us > 0) {
+			long max_wait = policy.max_delay_us*1000L;
+			if ((before_wait > 0 && total >= limit) || (wait == 0 && batch.size() > 1))
+				wait_ns = std::min(max_wait, std::max(2*wait, 16000L));
+			else if (expired)
+				wait_ns = wait < 2000 ? 0 : wait/2;
+		}
+		run_batch();
+	}
+}
+
+// -------------------
+// requests
+// -------------------
+void Intellino_frontend::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	Request request;
+	request.kind = LEARN;
+	request.multi_dataset_num = 1;
+	request.vector_length = vector_length;
+	request.data = (const char (*)[vector_max_len])learn_data;
+	request.categories = &learn_category;
+	enqueue(&request).wait();
+}
+
+void Intellino_frontend::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	Request request;
+	request.kind = LEARN_MULTI;
+	request.multi_dataset_num = multi_dataset_num;
+	request.vector_length = vector_length;
+	request.data = learn_multi_data;
+	request.categories = learn_multi_category;
+	enqueue(&request).wait();
+}
+
+void Intellino_frontend::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	// the batch copies whole rows, so a lone vector gets a full row of its own
+	char row[vector_max_len] = {0};
+	memcpy(row, test_data, vector_length < vector_max_len ? vector_length : vector_max_len);
+	classify_multi(1, vector_length, (const char (*)[vector_max_len])row, classified_distance, classified_category);
+}
+
+void Intellino_frontend::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	if (multi_dataset_num <= 0)
+		return;
+	Request request;
+	request.kind = CLASSIFY_MULTI;
+	request.multi_dataset_num = multi_dataset_num;
+	request.vector_length = vector_length;
+	request.data = test_multi_data;
+	request.distance = classified_multi_distance;
+	request.category = classified_multi_category;
+	enqueue(&request).wait();
+}
+
+std::future<void> Intellino_frontend::submit (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	Request* request = new Request;
+	request->owned = true;
+	request->kind = CLASSIFY_MULTI;
+	request->multi_dataset_num = multi_dataset_num;
+	request->vector_length = vector_length;
+	request->data = test_multi_data;
+	request->distance = classified_multi_distance;
+	request->category = classified_multi_category;
+	if (multi_dataset_num <= 0) {
+		std::future<void> done = request->done.get_future();
+		request->done.set_value();
+		delete request;
+		return done;
+	}
+	return enqueue(request);
+}
+
+void Intellino_frontend::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	Request request;
+	request.kind = CLASSIFY_TOPK;
+	request.multi_dataset_num = multi_dataset_num;
+	request.vector_length = vector_length;
+	request.k = k;
+	request.data = test_multi_data;
+	request.distance = classified_topk_distance;
+	request.category = classified_topk_category;
+	enqueue(&request).wait();
+}
@@ -0,0 +1,142 @@
+#ifndef INTELLINO_FRONTEND_H
+#define INTELLINO_FRONTEND_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "intellino_classifier.h"
+
+// Intrusive multi-producer / single-consumer queue (Vyukov). push() is one atomic
+// exchange and never blocks; pop() belongs to the single consumer and may return null
+// for a moment while a producer is between its two stores.
+struct Intellino_mpsc_node{
+    std::atomic<Intellino_mpsc_node*> next{nullptr};
+};
+
+class Intellino_mpsc_queue{
+private:
+    std::atomic<Intellino_mpsc_node*> head;
+    Intellino_mpsc_node* tail;
+    Intellino_mpsc_node stub;
+
+public:
+    Intellino_mpsc_queue() : head(&stub), tail(&stub) {}
+    Intellino_mpsc_queue(const Intellino_mpsc_queue&) = delete;
+    Intellino_mpsc_queue& operator=(const Intellino_mpsc_queue&) = delete;
+
+    void push (Intellino_mpsc_node* node);
+    Intellino_mpsc_node* pop ();
+};
+
+// When the bus-owner thread flushes a classify batch: as soon as it holds target_batch
+// vectors or its oldest request has been queued for max_delay_us, whichever comes first.
+// With auto_tune, target_batch follows the measured chip latency so that one batch takes
+// about max_delay_us on the bus, and the wait (up to max_delay_us) doubles when it fills a
+// batch and halves when it runs out, so synchronous callers that cannot fill a batch stop
+// paying for it while a bulk stream keeps full batches.
+// max_delay_us = 0 sends whatever is queued without waiting.
+struct Intellino_batch_policy{
+    int max_batch = 4096;
+    int max_delay_us = 500;
+    bool auto_tune = true;
+};
+
+// Thread-safe front end for one classifier. Any number of threads call learn / classify /
+// classify_multi (or submit() without waiting); each call becomes a request on a lock-free
+// queue. A single bus-owner thread drains the queue, packs consecutive classify requests
+// of the same vector length into one classify_multi (see Intellino_batch_policy), and
+// completes every request with its own slice of the answers. Requests run in queue order,
+// so a classify queued after a learn sees the learned vector.
+class Intellino_frontend : public Intellino_classifier{
+private:
+    typedef std::chrono::steady_clock clock;
+    enum Kind { LEARN, LEARN_MULTI, CLASSIFY_MULTI, CLASSIFY_TOPK };
+
+    struct Request : Intellino_mpsc_node{
+        Kind kind;
+        int multi_dataset_num;
+        int vector_length;
+        int k;
+        const char (*data)[vector_max_len];
+        const uint8_t* categories;
+        int *distance;
+        int *category;
+        clock::time_point queued;
+        std::promise<void> done;
+        bool owned = false;             // submit(): deleted by the bus thread when done
+    };
+
+    Intellino_classifier* chip;
+    Intellino_batch_policy policy;
+
+    Intellino_mpsc_queue queue;
+    std::atomic<long> pending{0};       // pushed but not yet popped
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> stopping{false};
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::thread bus_thread;
+
+    // bus-owner thread state
+    std::vector<char> batch_rows;
+    std::vector<int> batch_distance;
+    std::vector<int> batch_category;
+    std::vector<Request*> batch;
+    Request* carried = nullptr;         // popped but did not fit the previous batch
+    double ns_per_vector = 0;           // EWMA of chip classify_multi latency / vectors
+    std::atomic<int> target{0};
+    std::atomic<long> wait_ns{0};
+
+    std::atomic<long> batches{0};
+    std::atomic<long> requests{0};
+    std::atomic<long> flushed_full{0};
+    std::atomic<long> flushed_deadline{0};
+
+    std::future<void> enqueue (Request* request);
+    Request* next_request ();
+    void run (Request* request);
+    void run_batch ();
+    void tune (int vectors, clock::duration latency);
+    void bus_loop ();
+
+public:
+    // takes ownership of chip
+    Intellino_frontend(Intellino_classifier* chip, const Intellino_batch_policy& policy = Intellino_batch_policy());
+    ~Intellino_frontend();
+    Intellino_frontend(const Intellino_frontend&) = delete;
+    Intellino_frontend& operator=(const Intellino_frontend&) = delete;
+
+    // classify_multi without waiting; inputs and outputs must stay valid until the future is ready
+    std::future<void> submit (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+
+    // classify requests / classify_multi calls made on the chip so far
+    long classify_requests () const { return requests; }
+    long classify_batches () const { return batches; }
+    // batches sent because they reached target_batch / because their oldest request hit the wait;
+    // the rest went out because nothing more was queued or could join
+    long full_flushes () const { return flushed_full; }
+    long deadline_flushes () const { return flushed_deadline; }
+    // current auto-tuned batch target and wait
+    int target_batch () const { return target; }
+    long wait_us () const { return wait_ns / 1000; }
+
+    void collect_metrics (Intellino_metrics& total) { chip->collect_metrics(total); }
+    void reset_metrics () { chip->reset_metrics(); }
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+};
+
+#endif
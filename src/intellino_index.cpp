@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "intellino_index.h"
+
+static const int row_len = Intellino_knn::vector_max_len;
+
+Intellino_index::Intellino_index(const Intellino_index_config& config)
+	: rows(0, config.metric)
+{
+	this->config = config;
+	if (this->config.tables < 1)
+		this->config.tables = 1;
+	if (this->config.bits < 1)
+		this->config.bits = 1;
+	if (this->config.bits > 32)
+		this->config.bits = 32;
+	if (this->config.probes < 0)
+		this->config.probes = 0;
+	distance = config.metric == Intellino_knn::HAMMING ? intellino_hamming_distance : intellino_l1_distance;
+}
+
+Intellino_index::~Intellino_index(){
+	stop_async();
+}
+
+// -------------------
+// hash functions
+// -------------------
+uint32_t Intellino_index::key (const Table& table, const uint8_t* row) const
+{
+	uint32_t k = 0;
+	int n = (int)table.bits.size();
+	if (config.metric == Intellino_knn::HAMMING) {
+		for (int b=0; b<n; b++)
+			k |= (uint32_t)((row[table.bits[b].byte] & table.bits[b].value) != 0) << b;
+	}
+	else {
+		for (int b=0; b<n; b++)
+			k |= (uint32_t)(row[table.bits[b].byte] > table.bits[b].value) << b;
+	}
+	return k;
+}
+
+// L1 bits take distinct bytes within a table, each against the midpoint of two random
+// learned rows, so the threshold follows the data and splits it near the middle. A table
+// of more bits than the hash covers bytes (the default 14 on vectors under 14 bytes) deals
+// a fresh deck when one runs out, so its later bits cut bytes it already uses again, at
+// their own thresholds. HAMMING bits are dealt from one shuffled deck of bit positions:
+// tables only share bits once the deck runs out.
+void Intellino_index::draw ()
+{
+	std::mt19937 random(config.seed);
+	int count = rows.size();
+	tables.assign(config.tables, Table());
+
+	std::vector<int> deck;
+	size_t dealt = 0;
+	int positions = config.metric == Intellino_knn::HAMMING ? hash_length*8 : hash_length;
+	if (positions < 1)
+		positions = 1;
+	for (Table& table : tables) {
+		if (config.metric == Intellino_knn::L1)
+			dealt = deck.size();
+		for (int b=0; b<config.bits; b++) {
+			if (dealt == deck.size()) {
+				deck.resize(positions);
+				for (int i=0; i<positions; i++)
+					deck[i] = i;
+				std::shuffle(deck.begin(), deck.end(), random);
+				dealt = 0;
+			}
+			int position = deck[dealt++];
+			Hash_bit bit;
+			if (config.metric == Intellino_knn::HAMMING) {
+				bit.byte = (uint8_t)(position / 8);
+				bit.value = (uint8_t)(1 << (position % 8));
+			}
+			else {
+				int a = rows.row(random() % count)[position];
+				int c = rows.row(random() % count)[position];
+				bit.byte = (uint8_t)position;
+				bit.value = (uint8_t)((a + c) / 2);
+			}
+			table.bits.push_back(bit);
+		}
+	}
+
+	drawn_at = count;
+	indexed = 0;
+}
+
+void Intellino_index::index_rows ()
+{
+	int count = rows.size();
+	for (Table& table : tables)
+		for (int j=indexed; j<count; j++)
+			table.buckets[key(table, rows.row(j))].push_back(j);
+	indexed = count;
+}
+
+void Intellino_index::rebuild ()
+{
+	auto start = std::chrono::steady_clock::now();
+	draw();
+	index_rows();
+	build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Intellino_index::build ()
+{
+	std::lock_guard<std::mutex> lock(build_mutex);
+	if (rows.size() > 0)
+		rebuild();
+}
+
+void Intellino_index::update ()
+{
+	if (indexed == rows.size() || rows.size() < config.exact_rows)
+		return;
+	std::lock_guard<std::mutex> lock(build_mutex);
+	if (indexed == rows.size())
+		return;
+	if (!tables.empty() && rows.size() < 2*drawn_at)
+		index_rows();
+	else
+		rebuild();
+}
+
+// -------------------
+// LEARN
+// -------------------
+void Intellino_index::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	if (vector_length > row_len)
+		vector_length = row_len;
+	if (vector_length > hash_length)
+		hash_length = vector_length;
+	rows.learn(vector_length, (const uint8_t*)learn_data, learn_category);
+}
+
+void Intellino_index::learn_multi (int multi_dataset_num, int vector_length,
+				const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	for (int j=0; j<multi_dataset_num; j++)
+		learn(vector_length, learn_multi_data[j], learn_multi_category[j]);
+}
+
+// -------------------
+// CLASSIFY
+// -------------------
+// Query-directed multi-probe: a bit whose query byte sits right at its threshold is the one
+// a near row most likely has the other way. Each bit scores its margin (L1: bytes to the
+// threshold, HAMMING: 1 for every bit), a flip set the sum of its margins; the lowest scoring
+// single flips, and pairs among the 8 lowest margin bits, are probed.
+int Intellino_index::probe_masks (const Table& table, const uint8_t* query, uint32_t* masks) const
+{
+	int n = (int)table.bits.size();
+	if (config.probes == 0)
+		return 0;
+	uint64_t flips[32 + 28];        // (score << 32 | mask)
+	for (int b=0; b<n; b++) {
+		uint32_t margin = 1;
+		if (config.metric == Intellino_knn::L1) {
+			int q = query[table.bits[b].byte], t = table.bits[b].value;
+			margin = q > t ? q - t : t - q + 1;
+		}
+		flips[b] = ((uint64_t)margin << 32) | (1u << b);
+	}
+	int pool = n < 8 ? n : 8;
+	std::partial_sort(flips, flips + pool, flips + n);
+	int count = n;
+	for (int a=0; a<pool; a++)
+		for (int b=a+1; b<pool; b++)
+			flips[count++] = (((flips[a] >> 32) + (flips[b] >> 32)) << 32) | (uint32_t)(flips[a] | flips[b]);
+	int take = config.probes < count ? config.probes : count;
+	std::partial_sort(flips, flips + take, flips + count);
+	for (int i=0; i<take; i++)
+		masks[i] = (uint32_t)flips[i];
+	return take;
+}
+
+bool Intellino_index::candidates (const uint8_t* query, uint32_t limit, bool nearest_only, Scratch& scratch)
+{
+	scratch.found.clear();
+	scratch.seen.resize((rows.size() + 63) / 64);
+	bool any = false;
+	uint32_t masks[1 + 32 + 28];
+	for (const Table& table : tables) {
+		uint32_t k = key(table, query);
+		masks[0] = 0;
+		int probed = 1 + probe_masks(table, query, masks + 1);
+		for (int p=0; p<probed; p++) {
+			auto bucket = table.buckets.find(k ^ masks[p]);
+			if (bucket == table.buckets.end())
+				continue;
+			any = true;
+			for (int j : bucket->second) {
+				uint64_t bit = 1ull << (j % 64);
+				if (scratch.seen[j / 64] & bit)
+					continue;
+				scratch.seen[j / 64] |= bit;
+				scratch.touched.push_back(j);
+			}
+		}
+	}
+
+	// the rows are scattered over the whole store: fetch a few ahead of the one being ranked
+	const int ahead = 16;
+	int n = (int)scratch.touched.size();
+	for (int i=0; i<n; i++) {
+		if (i + ahead < n)
+			__builtin_prefetch(rows.row(scratch.touched[i + ahead]));
+		int j = scratch.touched[i];
+		scratch.seen[j / 64] = 0;
+		uint32_t d = distance(query, rows.row(j));
+		if (d < limit) {
+			scratch.found.push_back(((uint64_t)d << 32) | (uint32_t)j);
+			if (nearest_only)
+				limit = d + 1;
+		}
+	}
+	compared += n;
+	scratch.touched.clear();
+	return any;
+}
+
+void Intellino_index::nearest (int vector_length, const char* test_data, int reject_distance, Scratch& scratch,
+				int *classified_distance, int *classified_category)
+{
+	if (tables.empty() || rows.size() < config.exact_rows) {
+		rows.classify(vector_length, (const uint8_t*)test_data, classified_distance, classified_category, reject_distance);
+		return;
+	}
+	alignas(64) uint8_t query[row_len];
+	if (vector_length > row_len)
+		vector_length = row_len;
+	memcpy(query, test_data, vector_length);
+	memset(query + vector_length, 0, row_len - vector_length);
+
+	if (!candidates(query, reject_distance < 0 ? UINT32_MAX : (uint32_t)reject_distance + 1, true, scratch)) {
+		fallbacks++;
+		rows.classify(vector_length, query, classified_distance, classified_category, reject_distance);
+		return;
+	}
+	if (scratch.found.empty()) {
+		*classified_distance = max_distance;
+		*classified_category = unknown_category;
+		return;
+	}
+	// the closest, earliest learned on ties
+	uint64_t best = *std::min_element(scratch.found.begin(), scratch.found.end());
+	uint32_t d = (uint32_t)(best >> 32);
+	*classified_distance = d > (uint32_t)max_distance ? max_distance : (int)d;
+	*classified_category = rows.category((uint32_t)best);
+}
+
+void Intellino_index::classify_rows (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+				int *classified_multi_distance, int *classified_multi_category, int reject_distance)
+{
+	update();
+	queries += multi_dataset_num;
+
+	int threads = config.threads > 0 ? config.threads : (int)std::thread::hardware_concurrency();
+	if (threads > multi_dataset_num / 16)
+		threads = multi_dataset_num / 16;
+	if (threads < 1)
+		threads = 1;
+
+	auto run = [&](int first, int last) {
+		Scratch scratch;
+		for (int j=first; j<last; j++)
+			nearest(vector_length, test_multi_data[j], reject_distance, scratch,
+					&classified_multi_distance[j], &classified_multi_category[j]);
+	};
+
+	std::vector<std::thread> workers;
+	int per_thread = (multi_dataset_num + threads - 1) / threads;
+	for (int t=1; t<threads; t++) {
+		int first = t*per_thread;
+		int last = first + per_thread < multi_dataset_num ? first + per_thread : multi_dataset_num;
+		if (first < last)
+			workers.emplace_back(run, first, last);
+	}
+	run(0, per_thread < multi_dataset_num ? per_thread : multi_dataset_num);
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void Intellino_index::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	classify_rows(1, vector_length, (const char (*)[vector_max_len])test_data, classified_distance, classified_category, -1);
+}
+
+void Intellino_index::classify_multi (int multi_dataset_num, int vector_length,
+				const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	classify_rows(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category, -1);
+}
+
+int Intellino_index::classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+				const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	classify_rows(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category,
+			reject_distance);
+	int rejected = 0;
+	for (int j=0; j<multi_dataset_num; j++)
+		rejected += classified_multi_category[j] == unknown_category;
+	return rejected;
+}
+
+// ------------------------
+// CLASSIFY_TOPK
+// ------------------------
+// the k best candidates; fewer than k found leaves the rest at 0xFFFF / category 0
+void Intellino_index::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+				int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	update();
+	queries += multi_dataset_num;
+	Scratch scratch;
+	std::vector<uint64_t>& found = scratch.found;
+	for (int j=0; j<multi_dataset_num; j++) {
+		int* distance_out = classified_topk_distance + (size_t)j*k;
+		int* category_out = classified_topk_category + (size_t)j*k;
+		int length = vector_length > row_len ? row_len : vector_length;
+		alignas(64) uint8_t query[row_len];
+		memcpy(query, test_multi_data[j], length);
+		memset(query + length, 0, row_len - length);
+
+		if (tables.empty() || rows.size() < config.exact_rows) {
+			rows.classify_topk(length, query, k, distance_out, category_out);
+			continue;
+		}
+		if (!candidates(query, UINT32_MAX, false, scratch)) {
+			fallbacks++;
+			rows.classify_topk(length, query, k, distance_out, category_out);
+			continue;
+		}
+		int n = k < (int)found.size() ? k : (int)found.size();
+		std::partial_sort(found.begin(), found.begin() + n, found.end());
+		for (int i=0; i<n; i++) {
+			uint32_t d = (uint32_t)(found[i] >> 32);
+			distance_out[i] = d > (uint32_t)max_distance ? max_distance : (int)d;
+			category_out[i] = rows.category((uint32_t)found[i]);
+		}
+		for (int i=n; i<k; i++) {
+			distance_out[i] = max_distance;
+			category_out[i] = 0;
+		}
+	}
+}
+
+// -------------------
+// stats
+// -------------------
+Intellino_index::Stats Intellino_index::stats ()
+{
+	std::lock_guard<std::mutex> lock(build_mutex);
+	Stats s;
+	s.rows = rows.size();
+	s.tables = (int)tables.size();
+	s.buckets = 0;
+	for (const Table& table : tables)
+		s.buckets += (long)table.buckets.size();
+	s.build_seconds = build_seconds;
+	s.queries = queries;
+	s.compared = compared;
+	s.fallbacks = fallbacks;
+	return s;
+}
+
+void Intellino_index::print_stats (FILE* fp)
+{
+	Stats s = stats();
+	fprintf(fp, "index: %d rows in %d tables of %d bits + %d probes (%ld buckets, built in %.1f ms), %ld queries, %.1f candidates per query, %ld exhaustive\n",
+		s.rows, s.tables, config.bits, config.probes, s.buckets, s.build_seconds * 1e3, s.queries, s.candidates_per_query(), s.fallbacks);
+}
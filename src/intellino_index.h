@@ -0,0 +1,130 @@
+#ifndef INTELLINO_INDEX_H
+#define INTELLINO_INDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "intellino_classifier.h"
+#include "intellino_knn.h"
+
+// tables: independent hash tables, more = higher recall, more memory and lookups per query
+// bits: hash bits per table (1 .. 32), more = smaller buckets, fewer candidates
+// probes: extra buckets looked up per table, the keys one or two flipped bits away whose
+//   query bytes lie closest to their thresholds first (0 .. bits + 28)
+// exact_rows: below this many learned rows every query runs the exhaustive scan, which is
+//   faster there and exact (0 = always use the tables)
+// threads: classify_multi workers (0 = every hardware thread)
+struct Intellino_index_config{
+    Intellino_knn::Metric metric = Intellino_knn::L1;
+    int tables = 16;
+    int bits = 14;
+    int probes = 4;
+    int exact_rows = 8192;
+    int threads = 0;
+    uint32_t seed = 1;
+};
+
+// Approximate nearest neighbour search over learned sets of any size, for when the chip's
+// neurons run out and the exhaustive host scan (linear in the learned rows) gets too slow.
+// Locality sensitive hashing by bit sampling: each hash bit of an L1 table is one byte
+// compared against a threshold drawn from the learned rows (row[d] > t), which two vectors
+// agree on with a probability falling with their distance in that byte; a HAMMING bit is
+// one bit of the descriptor. When tables * bits fits the descriptor, the HAMMING tables get
+// disjoint substrings (multi-index hashing): every row within tables - 1 bits of the query
+// is then found, within 2 * tables - 1 bits with probes = bits.
+// Candidates from all probed buckets are ranked once each by their exact distance. A query
+// whose buckets are all empty falls back to the exhaustive scan, as does every query while
+// fewer than exact_rows vectors are learned. Hash functions are drawn from the learned rows
+// the first time a query needs them and redrawn once the learned set has doubled; rows
+// learned in between are hashed in on the next query. learn must not run concurrently with
+// classify, as on Intellino_knn.
+class Intellino_index : public Intellino_classifier{
+private:
+    struct Hash_bit{
+        uint8_t byte;
+        uint8_t value;      // L1: threshold, HAMMING: bit mask
+    };
+    struct Table{
+        std::vector<Hash_bit> bits;
+        std::unordered_map<uint32_t, std::vector<int>> buckets;
+    };
+
+    Intellino_index_config config;
+    Intellino_knn rows;
+    uint32_t (*distance) (const uint8_t* a, const uint8_t* b);
+    int hash_length = 0;                // longest vector learned, the bytes hash bits are drawn from
+    std::vector<Table> tables;
+    std::mutex build_mutex;
+    std::atomic<int> indexed{0};        // rows[0 .. indexed) are in the tables
+    int drawn_at = 0;                   // learned rows when the hash functions were drawn
+    double build_seconds = 0;
+
+    std::atomic<long> queries{0};
+    std::atomic<long> compared{0};
+    std::atomic<long> fallbacks{0};
+
+    uint32_t key (const Table& table, const uint8_t* row) const;
+    void draw ();
+    void index_rows ();
+    // draw + index_rows, timed; build_mutex held
+    void rebuild ();
+    // brings the tables up to the learned rows before a query
+    void update ();
+    // per-thread query state: the candidates and a bitmap of the rows already ranked
+    struct Scratch{
+        std::vector<uint64_t> found;    // (distance << 32 | row)
+        std::vector<uint64_t> seen;
+        std::vector<int> touched;
+    };
+    // key flips of the probes buckets to look up after the query's own, best first
+    int probe_masks (const Table& table, const uint8_t* query, uint32_t* masks) const;
+    // candidates of one padded query closer than limit (with nearest_only, only those that were
+    // the closest so far); returns false when every bucket was empty
+    bool candidates (const uint8_t* query, uint32_t limit, bool nearest_only, Scratch& scratch);
+    void nearest (int vector_length, const char* test_data, int reject_distance, Scratch& scratch,
+                int *classified_distance, int *classified_category);
+    void classify_rows (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int *classified_multi_distance, int *classified_multi_category, int reject_distance);
+
+public:
+    Intellino_index(const Intellino_index_config& config = Intellino_index_config());
+    ~Intellino_index();
+    Intellino_index(const Intellino_index&) = delete;
+    Intellino_index& operator=(const Intellino_index&) = delete;
+
+    int size () const { return rows.size(); }
+    // the learned rows; its classify / classify_multi is the exhaustive search the index approximates
+    const Intellino_knn& exact () const { return rows; }
+    // draws the hash functions from the rows learned so far and hashes all of them
+    void build ();
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+    // candidates past the bound are never ranked
+    int classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+
+    struct Stats{
+        int rows;
+        int tables;
+        long buckets;
+        double build_seconds;   // last full draw + hash of every row
+        long queries;
+        long compared;          // exact distances computed for candidates
+        long fallbacks;         // queries whose buckets were all empty, answered by the exhaustive scan
+        double candidates_per_query () const { return queries ? (double)compared / queries : 0; }
+    };
+    Stats stats ();
+    void print_stats (FILE* fp);
+};
+
+#endif
@@ -0,0 +1,684 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "intellino_knn.h"
+
+static const int row_len = Intellino_knn::vector_max_len;
+
+// -------------------
+// L1 distance kernels
+// -------------------
+// nearest() scans every stored row and keeps the first row with the smallest distance,
+// which is the order the chip resolves ties in (earliest learned neuron wins). Rows at
+// limit or farther never win (index -1 if none is closer). The scalar kernel skips the
+// second half of a row whose first half already reaches the best so far; a SIMD row is a
+// handful of instructions, where that check mispredicts more than it saves.
+// nearest() takes the 64-byte aligned query and rows of Intellino_knn; the pair kernels
+// behind intellino_l1_distance / intellino_hamming_distance load unaligned, since their
+// callers hand in rows from anywhere.
+typedef uint32_t (*l1_fn)(const uint8_t* a, const uint8_t* b);
+typedef void (*nearest_fn)(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index);
+
+static uint32_t l1_scalar_part(const uint8_t* a, const uint8_t* b, int len)
+{
+	uint32_t sum = 0;
+	for (int i=0; i<len; i++)
+		sum += (a[i] > b[i]) ? (a[i] - b[i]) : (b[i] - a[i]);
+	return sum;
+}
+
+static uint32_t l1_scalar(const uint8_t* a, const uint8_t* b)
+{
+	return l1_scalar_part(a, b, row_len);
+}
+
+static void nearest_scalar(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		const uint8_t* row = rows + (size_t)j*row_len;
+		uint32_t d = l1_scalar_part(query, row, row_len/2);
+		if (d >= best)
+			continue;
+		d += l1_scalar_part(query + row_len/2, row + row_len/2, row_len/2);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint32_t l1_sse2(const uint8_t* a, const uint8_t* b)
+{
+	__m128i s0 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+	__m128i s1 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a+16)), _mm_loadu_si128((const __m128i*)(b+16)));
+	__m128i s2 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a+32)), _mm_loadu_si128((const __m128i*)(b+32)));
+	__m128i s3 = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a+48)), _mm_loadu_si128((const __m128i*)(b+48)));
+	__m128i s = _mm_add_epi64(_mm_add_epi64(s0, s1), _mm_add_epi64(s2, s3));
+	s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+	return (uint32_t)_mm_cvtsi128_si32(s);
+}
+
+static void nearest_sse2(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	__m128i q0 = _mm_load_si128((const __m128i*)query);
+	__m128i q1 = _mm_load_si128((const __m128i*)(query+16));
+	__m128i q2 = _mm_load_si128((const __m128i*)(query+32));
+	__m128i q3 = _mm_load_si128((const __m128i*)(query+48));
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		const __m128i* r = (const __m128i*)(rows + (size_t)j*row_len);
+		__m128i s = _mm_add_epi64(_mm_add_epi64(_mm_sad_epu8(q0, _mm_load_si128(r)), _mm_sad_epu8(q1, _mm_load_si128(r+1))),
+					_mm_add_epi64(_mm_sad_epu8(q2, _mm_load_si128(r+2)), _mm_sad_epu8(q3, _mm_load_si128(r+3))));
+		s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+		uint32_t d = (uint32_t)_mm_cvtsi128_si32(s);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+
+__attribute__((target("avx2")))
+static uint32_t l1_avx2(const uint8_t* a, const uint8_t* b)
+{
+	__m256i s0 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)a), _mm256_loadu_si256((const __m256i*)b));
+	__m256i s1 = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a+32)), _mm256_loadu_si256((const __m256i*)(b+32)));
+	__m256i s = _mm256_add_epi64(s0, s1);
+	__m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+	h = _mm_add_epi64(h, _mm_unpackhi_epi64(h, h));
+	return (uint32_t)_mm_cvtsi128_si32(h);
+}
+
+// two rows per iteration so the horizontal reduction of one overlaps the loads of the other
+__attribute__((target("avx2")))
+static void nearest_avx2(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	__m256i q0 = _mm256_load_si256((const __m256i*)query);
+	__m256i q1 = _mm256_load_si256((const __m256i*)(query+32));
+	uint32_t best = limit;
+	int index = -1;
+	int j = 0;
+	for (; j+1<count; j+=2) {
+		const __m256i* r = (const __m256i*)(rows + (size_t)j*row_len);
+		__m256i a = _mm256_add_epi64(_mm256_sad_epu8(q0, _mm256_load_si256(r)), _mm256_sad_epu8(q1, _mm256_load_si256(r+1)));
+		__m256i b = _mm256_add_epi64(_mm256_sad_epu8(q0, _mm256_load_si256(r+2)), _mm256_sad_epu8(q1, _mm256_load_si256(r+3)));
+		// lanes: a0 a1 | a2 a3  and  b0 b1 | b2 b3  ->  (a0+a1, b0+b1 | a2+a3, b2+b3)
+		__m256i ab = _mm256_add_epi64(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+		__m128i h = _mm_add_epi64(_mm256_castsi256_si128(ab), _mm256_extracti128_si256(ab, 1));
+		uint32_t da = (uint32_t)_mm_cvtsi128_si32(h);
+		uint32_t db = (uint32_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(h, h));
+		if (da < best) {
+			best = da;
+			index = j;
+		}
+		if (db < best) {
+			best = db;
+			index = j+1;
+		}
+	}
+	if (j < count) {
+		uint32_t d = l1_avx2(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static uint32_t l1_neon(const uint8_t* a, const uint8_t* b)
+{
+	uint16x8_t acc = vdupq_n_u16(0);
+	for (int i=0; i<row_len; i+=16)
+		acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a+i), vld1q_u8(b+i)));
+	uint32x4_t s = vpaddlq_u16(acc);
+	uint64x2_t t = vpaddlq_u32(s);
+	return (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+}
+
+static void nearest_neon(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		uint32_t d = l1_neon(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+#endif
+
+// -------------------
+// Hamming distance kernels
+// -------------------
+// A 64-byte row is eight packed 64-bit words (512 bits, one BRISK descriptor); the
+// distance is the popcount of query XOR row.
+static const int row_words = row_len / 8;
+
+static inline uint64_t load_word(const uint8_t* p)
+{
+	uint64_t word;
+	memcpy(&word, p, 8);
+	return word;
+}
+
+static uint32_t hamming_scalar(const uint8_t* a, const uint8_t* b)
+{
+	uint32_t sum = 0;
+	for (int i=0; i<row_words; i++)
+		sum += __builtin_popcountll(load_word(a + 8*i) ^ load_word(b + 8*i));
+	return sum;
+}
+
+static void nearest_hamming_scalar(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		uint32_t d = hamming_scalar(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt")))
+static uint32_t hamming_popcnt(const uint8_t* a, const uint8_t* b)
+{
+	uint64_t sum = 0;
+	for (int i=0; i<row_words; i++)
+		sum += _mm_popcnt_u64(load_word(a + 8*i) ^ load_word(b + 8*i));
+	return (uint32_t)sum;
+}
+
+// the query words stay in registers, a row is eight xor + popcnt
+__attribute__((target("popcnt")))
+static void nearest_hamming_popcnt(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	uint64_t q[row_words];
+	for (int i=0; i<row_words; i++)
+		q[i] = load_word(query + 8*i);
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		const uint8_t* r = rows + (size_t)j*row_len;
+		uint64_t d = 0;
+		for (int i=0; i<row_words; i++)
+			d += _mm_popcnt_u64(q[i] ^ load_word(r + 8*i));
+		if (d < best) {
+			best = (uint32_t)d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint32_t hamming_avx512(const uint8_t* a, const uint8_t* b)
+{
+	__m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*)a), _mm512_loadu_si512((const void*)b));
+	return (uint32_t)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+}
+
+// per-byte bit counts of a 256-bit register: two nibble lookups through pshufb
+__attribute__((target("avx2")))
+static inline __m256i popcount_bytes_avx2(__m256i x)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+						0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+	return _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+				_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+}
+
+// the row's byte counts (at most 16 per byte over both halves) are summed with one SAD,
+// then reduced two rows at a time like nearest_avx2
+__attribute__((target("avx2")))
+static uint32_t hamming_avx2(const uint8_t* a, const uint8_t* b)
+{
+	__m256i c = _mm256_add_epi8(
+			popcount_bytes_avx2(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)a), _mm256_loadu_si256((const __m256i*)b))),
+			popcount_bytes_avx2(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a+32)), _mm256_loadu_si256((const __m256i*)(b+32)))));
+	__m256i s = _mm256_sad_epu8(c, _mm256_setzero_si256());
+	__m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+	h = _mm_add_epi64(h, _mm_unpackhi_epi64(h, h));
+	return (uint32_t)_mm_cvtsi128_si32(h);
+}
+
+__attribute__((target("avx2")))
+static void nearest_hamming_avx2(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	__m256i q0 = _mm256_load_si256((const __m256i*)query);
+	__m256i q1 = _mm256_load_si256((const __m256i*)(query+32));
+	const __m256i zero = _mm256_setzero_si256();
+	uint32_t best = limit;
+	int index = -1;
+	int j = 0;
+	for (; j+1<count; j+=2) {
+		const __m256i* r = (const __m256i*)(rows + (size_t)j*row_len);
+		__m256i a = _mm256_sad_epu8(_mm256_add_epi8(popcount_bytes_avx2(_mm256_xor_si256(q0, _mm256_load_si256(r))),
+					popcount_bytes_avx2(_mm256_xor_si256(q1, _mm256_load_si256(r+1)))), zero);
+		__m256i b = _mm256_sad_epu8(_mm256_add_epi8(popcount_bytes_avx2(_mm256_xor_si256(q0, _mm256_load_si256(r+2))),
+					popcount_bytes_avx2(_mm256_xor_si256(q1, _mm256_load_si256(r+3)))), zero);
+		__m256i ab = _mm256_add_epi64(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+		__m128i h = _mm_add_epi64(_mm256_castsi256_si128(ab), _mm256_extracti128_si256(ab, 1));
+		uint32_t da = (uint32_t)_mm_cvtsi128_si32(h);
+		uint32_t db = (uint32_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(h, h));
+		if (da < best) {
+			best = da;
+			index = j;
+		}
+		if (db < best) {
+			best = db;
+			index = j+1;
+		}
+	}
+	if (j < count) {
+		uint32_t d = hamming_avx2(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+
+// One row is one 512-bit register. Four rows share the horizontal reduction: their
+// per-word counts are folded pairwise until each 128-bit lane holds two row totals.
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void nearest_hamming_avx512(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	__m512i q = _mm512_load_si512((const void*)query);
+	uint32_t best = limit;
+	int index = -1;
+	int j = 0;
+	for (; j+3<count; j+=4) {
+		const uint8_t* r = rows + (size_t)j*row_len;
+		__m512i a = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512((const void*)r)));
+		__m512i b = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512((const void*)(r + row_len))));
+		__m512i c = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512((const void*)(r + 2*row_len))));
+		__m512i d = _mm512_popcnt_epi64(_mm512_xor_si512(q, _mm512_load_si512((const void*)(r + 3*row_len))));
+		// 128-bit lane k: (a, b) and (c, d) partial sums of words 2k, 2k+1
+		__m512i ab = _mm512_add_epi64(_mm512_unpacklo_epi64(a, b), _mm512_unpackhi_epi64(a, b));
+		__m512i cd = _mm512_add_epi64(_mm512_unpacklo_epi64(c, d), _mm512_unpackhi_epi64(c, d));
+		// lanes: (ab0+ab1, ab2+ab3, cd0+cd1, cd2+cd3), then pairs of lanes added
+		__m512i s = _mm512_add_epi64(_mm512_shuffle_i64x2(ab, cd, 0x88), _mm512_shuffle_i64x2(ab, cd, 0xDD));
+		s = _mm512_add_epi64(s, _mm512_shuffle_i64x2(s, s, 0xB1));
+		__m128i lo = _mm512_castsi512_si128(s);
+		__m128i hi = _mm512_extracti32x4_epi32(s, 2);
+		uint32_t d4[4] = {(uint32_t)_mm_cvtsi128_si64(lo), (uint32_t)_mm_extract_epi64(lo, 1),
+					(uint32_t)_mm_cvtsi128_si64(hi), (uint32_t)_mm_extract_epi64(hi, 1)};
+		for (int i=0; i<4; i++) {
+			if (d4[i] < best) {
+				best = d4[i];
+				index = j+i;
+			}
+		}
+	}
+	for (; j<count; j++) {
+		uint32_t d = hamming_avx512(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+#endif
+
+#if defined(__ARM_NEON)
+static uint32_t hamming_neon(const uint8_t* a, const uint8_t* b)
+{
+	uint16x8_t acc = vdupq_n_u16(0);
+	for (int i=0; i<row_len; i+=16)
+		acc = vpadalq_u8(acc, vcntq_u8(veorq_u8(vld1q_u8(a+i), vld1q_u8(b+i))));
+	uint64x2_t t = vpaddlq_u32(vpaddlq_u16(acc));
+	return (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+}
+
+static void nearest_hamming_neon(const uint8_t* query, const uint8_t* rows, int count, uint32_t limit, uint32_t* best_distance, int* best_index)
+{
+	uint32_t best = limit;
+	int index = -1;
+	for (int j=0; j<count; j++) {
+		uint32_t d = hamming_neon(query, rows + (size_t)j*row_len);
+		if (d < best) {
+			best = d;
+			index = j;
+		}
+	}
+	*best_distance = best;
+	*best_index = index;
+}
+#endif
+
+struct distance_kernels{
+	l1_fn distance;
+	nearest_fn nearest;
+	const char* name;
+};
+
+static distance_kernels select_l1_kernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return {l1_avx2, nearest_avx2, "avx2"};
+	if (__builtin_cpu_supports("sse2"))
+		return {l1_sse2, nearest_sse2, "sse2"};
+#endif
+#if defined(__ARM_NEON)
+	return {l1_neon, nearest_neon, "neon"};
+#endif
+	return {l1_scalar, nearest_scalar, "scalar"};
+}
+
+static distance_kernels select_hamming_kernels()
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512vpopcntdq"))
+		return {hamming_avx512, nearest_hamming_avx512, "avx512-vpopcntdq"};
+	if (__builtin_cpu_supports("avx2"))
+		return {hamming_avx2, nearest_hamming_avx2, "avx2"};
+	if (__builtin_cpu_supports("popcnt"))
+		return {hamming_popcnt, nearest_hamming_popcnt, "popcnt"};
+#endif
+#if defined(__ARM_NEON)
+	return {hamming_neon, nearest_hamming_neon, "neon"};
+#endif
+	return {hamming_scalar, nearest_hamming_scalar, "scalar"};
+}
+
+static const distance_kernels l1_kernels = select_l1_kernels();
+static const distance_kernels hamming_kernels = select_hamming_kernels();
+
+static inline const distance_kernels& kernels_for(Intellino_knn::Metric metric)
+{
+	return metric == Intellino_knn::HAMMING ? hamming_kernels : l1_kernels;
+}
+
+uint32_t intellino_l1_distance(const uint8_t* a, const uint8_t* b)
+{
+	return l1_kernels.distance(a, b);
+}
+
+uint32_t intellino_hamming_distance(const uint8_t* a, const uint8_t* b)
+{
+	return hamming_kernels.distance(a, b);
+}
+
+// -------------------
+// Intellino_knn
+// -------------------
+Intellino_knn::Intellino_knn(int capacity, Metric metric){
+	this->capacity = capacity;
+	this->metric = metric;
+	tile_rows = default_tile_rows;
+}
+
+const char* Intellino_knn::kernel_name() const
+{
+	return kernels_for(metric).name;
+}
+
+Intellino_knn::~Intellino_knn(){
+	free(vectors);
+	free(categories);
+}
+
+void Intellino_knn::clear()
+{
+	count = 0;
+}
+
+void Intellino_knn::reserve (int rows)
+{
+	if (rows <= reserved)
+		return;
+	uint8_t* grown_vectors = (uint8_t*)aligned_alloc(64, (size_t)rows*row_len);
+	uint16_t* grown_categories = (uint16_t*)malloc(sizeof(uint16_t)*rows);
+	if (grown_vectors == NULL || grown_categories == NULL)
+		abort();
+	if (count) {
+		memcpy(grown_vectors, vectors, (size_t)count*row_len);
+		memcpy(grown_categories, categories, sizeof(uint16_t)*count);
+	}
+	free(vectors);
+	free(categories);
+	vectors = grown_vectors;
+	categories = grown_categories;
+	reserved = rows;
+}
+
+void Intellino_knn::learn (int vector_length, const uint8_t* learn_data, uint16_t learn_category)
+{
+	if (capacity > 0 && count >= capacity)
+		return;
+
+	if (count == reserved)
+		reserve(reserved ? reserved*2 : 256);
+
+	if (vector_length > row_len)
+		vector_length = row_len;
+	uint8_t* row = vectors + (size_t)count*row_len;
+	memcpy(row, learn_data, vector_length);
+	memset(row + vector_length, 0, row_len - vector_length);
+	categories[count] = learn_category;
+	count++;
+}
+
+void Intellino_knn::classify (int vector_length, const uint8_t* test_data, int *classified_distance, int *classified_category,
+				int reject_distance) const
+{
+	if (count == 0) {
+		*classified_distance = max_distance;
+		*classified_category = reject_distance < 0 ? 0 : unknown_category;
+		return;
+	}
+
+	alignas(64) uint8_t query[row_len];
+	if (vector_length > row_len)
+		vector_length = row_len;
+	memcpy(query, test_data, vector_length);
+	memset(query + vector_length, 0, row_len - vector_length);
+
+	uint32_t distance;
+	int index;
+	kernels_for(metric).nearest(query, vectors, count, reject_distance < 0 ? UINT32_MAX : (uint32_t)reject_distance + 1, &distance, &index);
+	if (index < 0) {
+		*classified_distance = max_distance;
+		*classified_category = unknown_category;
+		return;
+	}
+
+	*classified_distance = distance > (uint32_t)max_distance ? max_distance : (int)distance;
+	*classified_category = categories[index];
+}
+
+int Intellino_knn::classify_topk (int vector_length, const uint8_t* test_data, int k, int *classified_distance, int *classified_category) const
+{
+	int found = k < count ? k : count;
+	if (found > 0) {
+		alignas(64) uint8_t query[row_len];
+		if (vector_length > row_len)
+			vector_length = row_len;
+		memcpy(query, test_data, vector_length);
+		memset(query + vector_length, 0, row_len - vector_length);
+
+		// (distance << 32 | row) orders by distance, then by learn order
+		l1_fn distance = kernels_for(metric).distance;
+		std::vector<uint64_t> keys(count);
+		for (int j=0; j<count; j++)
+			keys[j] = ((uint64_t)distance(query, vectors + (size_t)j*row_len) << 32) | (uint32_t)j;
+		std::partial_sort(keys.begin(), keys.begin() + found, keys.end());
+
+		for (int i=0; i<found; i++) {
+			uint32_t distance = (uint32_t)(keys[i] >> 32);
+			classified_distance[i] = distance > (uint32_t)max_distance ? max_distance : (int)distance;
+			classified_category[i] = categories[(uint32_t)keys[i]];
+		}
+	}
+	for (int i=found; i<k; i++) {
+		classified_distance[i] = max_distance;
+		classified_category[i] = 0;
+	}
+	return found;
+}
+
+// -------------------
+// blocked CLASSIFY_MULTI
+// -------------------
+void Intellino_knn::nearest_rows (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+				int first_row, int last_row, uint32_t* best_distance, int* best_index) const
+{
+	nearest_fn nearest = kernels_for(metric).nearest;
+	if (vector_length > row_len)
+		vector_length = row_len;
+	int tile = tile_rows > 0 ? tile_rows : last_row - first_row;
+	if (tile < 1)
+		tile = 1;
+	// without blocking a block is one query, so each query streams all rows on its own
+	int block = tile_rows > 0 ? query_block : 1;
+
+	alignas(64) uint8_t queries[query_block][row_len];
+	for (int first=0; first<multi_dataset_num; first+=block) {
+		int n = multi_dataset_num - first < block ? multi_dataset_num - first : block;
+		for (int q=0; q<n; q++) {
+			memcpy(queries[q], test_multi_data[first + q], vector_length);
+			memset(queries[q] + vector_length, 0, row_len - vector_length);
+		}
+		for (int start=first_row; start<last_row; start+=tile) {
+			int rows = last_row - start < tile ? last_row - start : tile;
+			const uint8_t* base = vectors + (size_t)start*row_len;
+			for (int q=0; q<n; q++) {
+				uint32_t distance;
+				int index;
+				nearest(queries[q], base, rows, best_distance[first + q], &distance, &index);
+				if (index >= 0) {
+					best_distance[first + q] = distance;
+					best_index[first + q] = start + index;
+				}
+			}
+		}
+	}
+}
+
+// A batch of at least 16 queries per thread splits the queries. A smaller batch over a
+// learned set of several tiles per thread splits the rows instead: each thread keeps the
+// best of its slice and the slices merge in row order, so ties still go to the earliest row.
+void Intellino_knn::classify_multi (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+				int *classified_multi_distance, int *classified_multi_category, int threads, int reject_distance) const
+{
+	if (multi_dataset_num <= 0)
+		return;
+	if (count == 0) {
+		for (int j=0; j<multi_dataset_num; j++) {
+			classified_multi_distance[j] = max_distance;
+			classified_multi_category[j] = reject_distance < 0 ? 0 : unknown_category;
+		}
+		return;
+	}
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	uint32_t limit = reject_distance < 0 ? UINT32_MAX : (uint32_t)reject_distance + 1;
+	std::vector<uint32_t> best_distance(multi_dataset_num, limit);
+	std::vector<int> best_index(multi_dataset_num, -1);
+
+	// below a few rows per thread the thread start costs more than it saves
+	int query_threads = threads < multi_dataset_num / 16 ? threads : multi_dataset_num / 16;
+	int tile = tile_rows > 0 ? tile_rows : default_tile_rows;
+	std::vector<std::thread> workers;
+	if (query_threads < threads && count >= 4*tile*threads) {
+		std::vector<std::vector<uint32_t>> slice_distance(threads);
+		std::vector<std::vector<int>> slice_index(threads);
+		int per_thread = (count + threads - 1) / threads;
+		auto run = [&](int t) {
+			int first = t*per_thread;
+			int last = first + per_thread < count ? first + per_thread : count;
+			uint32_t* distance = best_distance.data();
+			int* index = best_index.data();
+			if (t > 0) {
+				slice_distance[t].assign(multi_dataset_num, limit);
+				slice_index[t].assign(multi_dataset_num, -1);
+				distance = slice_distance[t].data();
+				index = slice_index[t].data();
+			}
+			nearest_rows(multi_dataset_num, vector_length, test_multi_data, first, last, distance, index);
+		};
+		for (int t=1; t<threads; t++)
+			workers.emplace_back(run, t);
+		run(0);
+		for (int t=1; t<threads; t++) {
+			workers[t-1].join();
+			for (int j=0; j<multi_dataset_num; j++) {
+				if (slice_index[t][j] >= 0 && slice_distance[t][j] < best_distance[j]) {
+					best_distance[j] = slice_distance[t][j];
+					best_index[j] = slice_index[t][j];
+				}
+			}
+		}
+	}
+	else {
+		if (query_threads < 1)
+			query_threads = 1;
+		int per_thread = (multi_dataset_num + query_threads - 1) / query_threads;
+		auto run = [&](int first, int last) {
+			nearest_rows(last - first, vector_length, test_multi_data + first, 0, count,
+					best_distance.data() + first, best_index.data() + first);
+		};
+		for (int t=1; t<query_threads; t++) {
+			int first = t*per_thread;
+			int last = first + per_thread < multi_dataset_num ? first + per_thread : multi_dataset_num;
+			if (first < last)
+				workers.emplace_back(run, first, last);
+		}
+		run(0, per_thread < multi_dataset_num ? per_thread : multi_dataset_num);
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	for (int j=0; j<multi_dataset_num; j++) {
+		if (best_index[j] < 0) {
+			classified_multi_distance[j] = max_distance;
+			classified_multi_category[j] = unknown_category;
+			continue;
+		}
+		uint32_t distance = best_distance[j];
+		classified_multi_distance[j] = distance > (uint32_t)max_distance ? max_distance : (int)distance;
+		classified_multi_category[j] = categories[best_index[j]];
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef INTELLINO_KNN_H
+#define INTELLINO_KNN_H
+
+#include <stdint.h>
+
+// Host-side nearest neighbour engine with the same L1 (sum of absolute differences)
+// metric as the chip. Vectors are stored zero padded to vector_max_len bytes, one 64-byte
+// aligned cache line per row, with the categories in a separate array, so the distance
+// kernel always runs over one fixed row and a scan touches nothing but rows.
+// classify_multi evaluates blocks of queries against tiles of tile_rows rows: a tile is
+// read from memory once per block and stays in cache while every query of the block scans it.
+// Queries are split over threads, or the rows when the batch is too small for that.
+// The HAMMING metric (host only, the chip has no equivalent) counts differing bits instead,
+// for binary descriptors such as BRISK. Each row is then eight packed 64-bit words
+// compared with popcnt, or AVX-512 VPOPCNTDQ where the CPU has it.
+class Intellino_knn{
+public:
+    enum Metric { L1, HAMMING };
+
+private:
+    Metric metric;
+    uint8_t* vectors = nullptr;
+    uint16_t* categories = nullptr;
+    int count = 0;
+    int reserved = 0;
+    int capacity = 0;
+    int tile_rows;
+
+public:
+    static const int vector_max_len = 64;
+    static const int max_distance = 0xFFFF;
+    static const int unknown_category = -1;
+    static const int default_tile_rows = 512;       // 32 KB of rows: L1 on most cores, L2 on any
+    static const int query_block = 32;              // queries run over a tile while it is hot
+
+    // capacity = 0 means unlimited, otherwise learn() ignores vectors past capacity like a full chip
+    Intellino_knn(int capacity = 0, Metric metric = L1);
+    ~Intellino_knn();
+    Intellino_knn(const Intellino_knn&) = delete;
+    Intellino_knn& operator=(const Intellino_knn&) = delete;
+
+    int size() const { return count; }
+    // learned row index, zero padded to vector_max_len and 64-byte aligned
+    const uint8_t* row(int index) const { return vectors + (size_t)index*vector_max_len; }
+    int category(int index) const { return categories[index]; }
+    Metric distance_metric() const { return metric; }
+    // kernel picked for this CPU and metric ("avx2", "popcnt", "avx512-vpopcntdq", ...)
+    const char* kernel_name() const;
+    void clear();
+    // room for rows vectors without regrowing (millions of rows are copied once per doubling otherwise)
+    void reserve (int rows);
+    // 0 = no blocking, every query scans all rows on its own
+    void set_tile_rows (int rows) { tile_rows = rows; }
+    void learn (int vector_length, const uint8_t* learn_data, uint16_t learn_category);
+    // reject_distance >= 0: a query with no row within it (nothing learned included) answers
+    // max_distance / unknown_category, and rows stop being summed once they pass the best
+    // distance so far (< 0 = no bound)
+    void classify (int vector_length, const uint8_t* test_data, int *classified_distance, int *classified_category,
+                int reject_distance = -1) const;
+    // the k nearest rows sorted by (distance, learn order); slots past size() get
+    // max_distance / category 0 like an exhausted chip. Returns the rows found.
+    int classify_topk (int vector_length, const uint8_t* test_data, int k, int *classified_distance, int *classified_category) const;
+    // queries split over threads (0 = every hardware thread), same answers as classify()
+    void classify_multi (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int *classified_multi_distance, int *classified_multi_category, int threads = 0, int reject_distance = -1) const;
+    // One partition of classify_multi: the nearest of rows [first_row, last_row) for every
+    // query, blocked over tiles. best_distance holds the limit on entry (rows at or past it
+    // never win) and the nearest distance on return; best_index the row, or -1 if none was
+    // closer. Threads may each run a slice of the rows into their own arrays; merging by the
+    // smaller distance, lower row on ties, gives the classify_multi answer.
+    void nearest_rows (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int first_row, int last_row, uint32_t* best_distance, int* best_index) const;
+};
+
+// L1 distance between two 64-byte rows at any alignment (AVX2 / SSE2 / NEON selected at runtime)
+uint32_t intellino_l1_distance(const uint8_t* a, const uint8_t* b);
+// Hamming distance between two 64-byte rows at any alignment (popcnt / AVX-512 VPOPCNTDQ / NEON
+// selected at runtime)
+uint32_t intellino_hamming_distance(const uint8_t* a, const uint8_t* b);
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "intellino_metrics.h"
+
+// -------------------
+// Intellino_histogram
+// -------------------
+// values below 16 ns get one bucket each, above that 16 buckets per power of two
+static int bucket_of(uint64_t ns)
+{
+	if (ns < Intellino_histogram::sub_buckets)
+		return (int)ns;
+	int exponent = 63 - __builtin_clzll(ns);
+	if (exponent >= Intellino_histogram::max_exponent)
+		return Intellino_histogram::buckets - 1;
+	return (exponent - 3)*Intellino_histogram::sub_buckets + (int)((ns >> (exponent - 4)) & (Intellino_histogram::sub_buckets - 1));
+}
+
+// middle of the bucket's range
+static uint64_t bucket_value(int bucket)
+{
+	if (bucket < Intellino_histogram::sub_buckets)
+		return bucket;
+	int exponent = bucket/Intellino_histogram::sub_buckets + 3;
+	uint64_t width = (uint64_t)1 << (exponent - 4);
+	uint64_t lower = (uint64_t)(Intellino_histogram::sub_buckets + bucket%Intellino_histogram::sub_buckets) << (exponent - 4);
+	return lower + width/2;
+}
+
+void Intellino_histogram::record (uint64_t ns)
+{
+	counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t seen = max.load(std::memory_order_relaxed);
+	while (ns > seen && !max.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+		;
+}
+
+void Intellino_histogram::add (const Intellino_histogram& other)
+{
+	for (int i=0; i<buckets; i++)
+		counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	total.fetch_add(other.count(), std::memory_order_relaxed);
+	sum.fetch_add(other.sum_ns(), std::memory_order_relaxed);
+	uint64_t ns = other.max_ns();
+	uint64_t seen = max.load(std::memory_order_relaxed);
+	while (ns > seen && !max.compare_exchange_weak(seen, ns, std::memory_order_relaxed))
+		;
+}
+
+void Intellino_histogram::reset ()
+{
+	for (int i=0; i<buckets; i++)
+		counts[i].store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Intellino_histogram::percentile_ns (double q) const
+{
+	uint64_t n = count();
+	if (n == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(q*n + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > n)
+		rank = n;
+	uint64_t seen = 0;
+	for (int i=0; i<buckets; i++) {
+		seen += counts[i].load(std::memory_order_relaxed);
+		if (seen >= rank) {
+			uint64_t value = bucket_value(i);
+			return value < max_ns() ? value : max_ns();
+		}
+	}
+	return max_ns();
+}
+
+// -------------------
+// Intellino_metrics
+// -------------------
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Intellino_metrics::clock::now().time_since_epoch()).count();
+}
+
+Intellino_metrics::Intellino_metrics() : started_ns(now_ns()){
+}
+
+const char* Intellino_metrics::op_name (Op op)
+{
+	static const char* names[OPS] = {"learn", "learn_multi", "classify", "classify_multi", "classify_topk"};
+	return names[op];
+}
+
+const char* Intellino_metrics::phase_name (Phase phase)
+{
+	static const char* names[PHASES] = {"encode", "transfer", "decode", "total"};
+	return names[phase];
+}
+
+void Intellino_metrics::record (Op op, Phase phase, clock::time_point start, clock::time_point end)
+{
+	histograms[op][phase].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void Intellino_metrics::count (Op op, long vectors, long bytes, long messages)
+{
+	op_calls[op].fetch_add(1, std::memory_order_relaxed);
+	op_vectors[op].fetch_add(vectors, std::memory_order_relaxed);
+	bus_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	bus_messages.fetch_add(messages, std::memory_order_relaxed);
+}
+
+double Intellino_metrics::seconds () const
+{
+	return (now_ns() - started_ns.load(std::memory_order_relaxed)) / 1e9;
+}
+
+double Intellino_metrics::bytes_per_sec () const
+{
+	double s = seconds();
+	return s > 0 ? bytes() / s : 0;
+}
+
+double Intellino_metrics::vectors_per_sec () const
+{
+	double s = seconds();
+	uint64_t total = 0;
+	for (int op=0; op<OPS; op++)
+		total += vectors((Op)op);
+	return s > 0 ? total / s : 0;
+}
+
+void Intellino_metrics::add (const Intellino_metrics& other)
+{
+	for (int op=0; op<OPS; op++) {
+		for (int phase=0; phase<PHASES; phase++)
+			histograms[op][phase].add(other.histograms[op][phase]);
+		op_calls[op].fetch_add(other.calls((Op)op), std::memory_order_relaxed);
+		op_vectors[op].fetch_add(other.vectors((Op)op), std::memory_order_relaxed);
+	}
+	bus_bytes.fetch_add(other.bytes(), std::memory_order_relaxed);
+	bus_messages.fetch_add(other.messages(), std::memory_order_relaxed);
+	// rates of the sum cover the longest-running member
+	int64_t started = other.started_ns.load(std::memory_order_relaxed);
+	if (started < started_ns.load(std::memory_order_relaxed))
+		started_ns.store(started, std::memory_order_relaxed);
+}
+
+void Intellino_metrics::reset ()
+{
+	for (int op=0; op<OPS; op++) {
+		for (int phase=0; phase<PHASES; phase++)
+			histograms[op][phase].reset();
+		op_calls[op].store(0, std::memory_order_relaxed);
+		op_vectors[op].store(0, std::memory_order_relaxed);
+	}
+	bus_bytes.store(0, std::memory_order_relaxed);
+	bus_messages.store(0, std::memory_order_relaxed);
+	started_ns.store(now_ns(), std::memory_order_relaxed);
+}
+
+// -------------------
+// dumps
+// -------------------
+void Intellino_metrics::write (FILE* fp, Format format) const
+{
+	if (format == PROMETHEUS)
+		write_prometheus(fp);
+	else
+		write_json(fp);
+}
+
+void Intellino_metrics::write_json (FILE* fp) const
+{
+	fprintf(fp, "{\"seconds\": %.6f, \"bytes\": %llu, \"messages\": %llu, \"bytes_per_sec\": %.1f, \"vectors_per_sec\": %.1f, \"ops\": {",
+		seconds(), (unsigned long long)bytes(), (unsigned long long)messages(), bytes_per_sec(), vectors_per_sec());
+	for (int op=0; op<OPS; op++) {
+		fprintf(fp, "%s\n  \"%s\": {\"calls\": %llu, \"vectors\": %llu, \"latency_ns\": {", op ? "," : "",
+			op_name((Op)op), (unsigned long long)calls((Op)op), (unsigned long long)vectors((Op)op));
+		for (int phase=0; phase<PHASES; phase++) {
+			const Intellino_histogram& h = histograms[op][phase];
+			fprintf(fp, "%s\n    \"%s\": {\"count\": %llu, \"sum\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+				phase ? "," : "", phase_name((Phase)phase), (unsigned long long)h.count(), (unsigned long long)h.sum_ns(),
+				(unsigned long long)h.percentile_ns(0.5), (unsigned long long)h.percentile_ns(0.99),
+				(unsigned long long)h.percentile_ns(0.999), (unsigned long long)h.max_ns());
+		}
+		fprintf(fp, "}}");
+	}
+	fprintf(fp, "\n}}\n");
+}
+
+// text exposition format; latencies are summaries with the three quantiles, in seconds
+void Intellino_metrics::write_prometheus (FILE* fp) const
+{
+	static const double quantiles[] = {0.5, 0.99, 0.999};
+
+	fprintf(fp, "# HELP intellino_latency_seconds Intellino_spi call latency by operation and phase.\n");
+	fprintf(fp, "# TYPE intellino_latency_seconds summary\n");
+	for (int op=0; op<OPS; op++) {
+		for (int phase=0; phase<PHASES; phase++) {
+			const Intellino_histogram& h = histograms[op][phase];
+			const char* o = op_name((Op)op);
+			const char* p = phase_name((Phase)phase);
+			for (double q : quantiles)
+				fprintf(fp, "intellino_latency_seconds{op=\"%s\",phase=\"%s\",quantile=\"%g\"} %.9f\n", o, p, q, h.percentile_ns(q) / 1e9);
+			fprintf(fp, "intellino_latency_seconds_sum{op=\"%s\",phase=\"%s\"} %.9f\n", o, p, h.sum_ns() / 1e9);
+			fprintf(fp, "intellino_latency_seconds_count{op=\"%s\",phase=\"%s\"} %llu\n", o, p, (unsigned long long)h.count());
+		}
+	}
+
+	fprintf(fp, "# HELP intellino_calls_total Intellino_spi calls by operation.\n");
+	fprintf(fp, "# TYPE intellino_calls_total counter\n");
+	for (int op=0; op<OPS; op++)
+		fprintf(fp, "intellino_calls_total{op=\"%s\"} %llu\n", op_name((Op)op), (unsigned long long)calls((Op)op));
+	fprintf(fp, "# HELP intellino_vectors_total Vectors learned or classified by operation.\n");
+	fprintf(fp, "# TYPE intellino_vectors_total counter\n");
+	for (int op=0; op<OPS; op++)
+		fprintf(fp, "intellino_vectors_total{op=\"%s\"} %llu\n", op_name((Op)op), (unsigned long long)vectors((Op)op));
+	fprintf(fp, "# HELP intellino_bus_bytes_total SPI bytes clocked out (and back in).\n");
+	fprintf(fp, "# TYPE intellino_bus_bytes_total counter\n");
+	fprintf(fp, "intellino_bus_bytes_total %llu\n", (unsigned long long)bytes());
+	fprintf(fp, "# HELP intellino_bus_messages_total SPI messages (spidev ioctls) issued.\n");
+	fprintf(fp, "# TYPE intellino_bus_messages_total counter\n");
+	fprintf(fp, "intellino_bus_messages_total %llu\n", (unsigned long long)messages());
+	fprintf(fp, "# TYPE intellino_bytes_per_second gauge\n");
+	fprintf(fp, "intellino_bytes_per_second %.1f\n", bytes_per_sec());
+	fprintf(fp, "# TYPE intellino_vectors_per_second gauge\n");
+	fprintf(fp, "intellino_vectors_per_second %.1f\n", vectors_per_sec());
+}
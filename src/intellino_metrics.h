@@ -0,0 +1,89 @@
+#ifndef INTELLINO_METRICS_H
+#define INTELLINO_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+
+// Latency histogram in nanoseconds with 16 linear sub-buckets per power of two, so a
+// reported percentile is within ~3% of the true value. Recording is a couple of relaxed
+// atomic increments; readers may sample it while another thread records.
+class Intellino_histogram{
+public:
+    static const int sub_buckets = 16;
+    static const int max_exponent = 40;     // ~18 minutes, longer samples land in the last bucket
+    static const int buckets = (max_exponent - 3)*sub_buckets;
+
+    Intellino_histogram() {}
+    Intellino_histogram(const Intellino_histogram&) = delete;
+    Intellino_histogram& operator=(const Intellino_histogram&) = delete;
+
+    void record (uint64_t ns);
+    void add (const Intellino_histogram& other);
+    void reset ();
+
+    uint64_t count () const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum_ns () const { return sum.load(std::memory_order_relaxed); }
+    uint64_t max_ns () const { return max.load(std::memory_order_relaxed); }
+    // q in [0, 1], 0 when nothing was recorded
+    uint64_t percentile_ns (double q) const;
+
+private:
+    std::atomic<uint64_t> counts[buckets] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// Per-operation latency (split into encode / transfer / decode, plus the whole call) and
+// throughput counters of one Intellino_spi. Times come from the monotonic clock, so time
+// spent blocked in the spidev ioctl is counted, unlike the process CPU time of clock().
+class Intellino_metrics{
+public:
+    enum Op { LEARN, LEARN_MULTI, CLASSIFY, CLASSIFY_MULTI, CLASSIFY_TOPK, OPS };
+    enum Phase { ENCODE, TRANSFER, DECODE, TOTAL, PHASES };
+    enum Format { JSON, PROMETHEUS };
+
+    typedef std::chrono::steady_clock clock;
+
+    Intellino_metrics();
+    Intellino_metrics(const Intellino_metrics&) = delete;
+    Intellino_metrics& operator=(const Intellino_metrics&) = delete;
+
+    void record (Op op, Phase phase, clock::time_point start, clock::time_point end);
+    // one finished call moving `vectors` vectors and `bytes` bus bytes (each direction)
+    // in `messages` bus messages (spidev ioctls)
+    void count (Op op, long vectors, long bytes, long messages);
+
+    const Intellino_histogram& latency (Op op, Phase phase) const { return histograms[op][phase]; }
+    uint64_t calls (Op op) const { return op_calls[op].load(std::memory_order_relaxed); }
+    uint64_t vectors (Op op) const { return op_vectors[op].load(std::memory_order_relaxed); }
+    uint64_t bytes () const { return bus_bytes.load(std::memory_order_relaxed); }
+    uint64_t messages () const { return bus_messages.load(std::memory_order_relaxed); }
+    // rates over the wall time since construction / reset()
+    double seconds () const;
+    double bytes_per_sec () const;
+    double vectors_per_sec () const;
+
+    // folds another chip's numbers into this one (cluster totals)
+    void add (const Intellino_metrics& other);
+    void reset ();
+
+    void write (FILE* fp, Format format) const;
+    void write_json (FILE* fp) const;
+    void write_prometheus (FILE* fp) const;
+
+    static const char* op_name (Op op);
+    static const char* phase_name (Phase phase);
+
+private:
+    Intellino_histogram histograms[OPS][PHASES];
+    std::atomic<uint64_t> op_calls[OPS] = {};
+    std::atomic<uint64_t> op_vectors[OPS] = {};
+    std::atomic<uint64_t> bus_bytes{0};
+    std::atomic<uint64_t> bus_messages{0};
+    std::atomic<int64_t> started_ns;     // clock::now() at construction / reset()
+};
+
+#endif
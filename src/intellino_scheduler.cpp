@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "intellino_scheduler.h"
+
+// weight of the newest slice in the ns/vector averages
+static const double estimate_weight = 0.2;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+Intellino_scheduler::Intellino_scheduler(Intellino_classifier* chip, int neuron_capacity, int cpu_threads, int split_rows)
+		: shadow(neuron_capacity){
+	this->chip = chip;
+	this->cpu_threads = cpu_threads;
+	this->split_rows = split_rows > 0 ? split_rows : 256;
+}
+
+Intellino_scheduler::~Intellino_scheduler(){
+	stop_async();
+	if (chip_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(chip_mutex);
+			chip_stop = true;
+		}
+		chip_cv.notify_one();
+		chip_thread.join();
+	}
+	delete chip;
+}
+
+void Intellino_scheduler::record (double* ns_per_vector, double elapsed_ns, int vectors)
+{
+	double sample = elapsed_ns / vectors;
+	std::lock_guard<std::mutex> lock(estimate_mutex);
+	*ns_per_vector = *ns_per_vector == 0 ? sample : *ns_per_vector + estimate_weight*(sample - *ns_per_vector);
+}
+
+void Intellino_scheduler::chip_loop ()
+{
+	std::unique_lock<std::mutex> lock(chip_mutex);
+	while (true) {
+		chip_cv.wait(lock, [this]{ return chip_stop || !chip_jobs.empty(); });
+		if (chip_jobs.empty())
+			return;
+
+		Chip_job job = std::move(chip_jobs.front());
+		chip_jobs.pop_front();
+		lock.unlock();
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> busy(chip_busy);
+			chip->classify_multi(job.multi_dataset_num, job.vector_length, job.test_multi_data,
+					job.classified_multi_distance, job.classified_multi_category);
+		}
+		record(&chip_ns_per_vector, elapsed_ns(start), job.multi_dataset_num);
+		chip_backlog -= job.multi_dataset_num;
+		job.done.set_value();
+		lock.lock();
+	}
+}
+
+void Intellino_scheduler::classify_on_cpu (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int *classified_multi_distance, int *classified_multi_category, int reject_distance)
+{
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::shared_lock<std::shared_mutex> lock(shadow_mutex);
+		shadow.classify_multi(multi_dataset_num, vector_length, test_multi_data,
+				classified_multi_distance, classified_multi_category, cpu_threads, reject_distance);
+	}
+	record(&cpu_ns_per_vector, elapsed_ns(start), multi_dataset_num);
+}
+
+// ------------------------------
+// intellino LEARN
+// ------------------------------
+void Intellino_scheduler::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	chip->learn(vector_length, learn_data, learn_category);
+	std::unique_lock<std::shared_mutex> lock(shadow_mutex);
+	shadow.learn(vector_length, (const uint8_t*)learn_data, learn_category);
+}
+
+void Intellino_scheduler::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	chip->learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	std::unique_lock<std::shared_mutex> lock(shadow_mutex);
+	for (int j=0; j<multi_dataset_num; j++)
+		shadow.learn(vector_length, (const uint8_t*)learn_multi_data[j], learn_multi_category[j]);
+}
+
+// ------------------------------
+// intellino CLASSIFY
+// ------------------------------
+// a lone vector is not worth queueing: the chip takes it when idle, the host otherwise
+void Intellino_scheduler::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	{
+		std::unique_lock<std::mutex> busy(chip_busy, std::try_to_lock);
+		if (busy.owns_lock() && chip_backlog == 0) {
+			chip->classify(vector_length, test_data, classified_distance, classified_category);
+			return;
+		}
+	}
+	std::shared_lock<std::shared_mutex> lock(shadow_mutex);
+	shadow.classify(vector_length, (const uint8_t*)test_data, classified_distance, classified_category);
+}
+
+// ------------------------------
+// intellino CLASSIFY_MULTI
+// ------------------------------
+// Slices go to the chip queue while the chip would finish them first, counting the
+// vectors already queued ahead of them; otherwise the caller answers them on the host
+// while the chip drains. Until both sides are measured the chip gets the first slice
+// and the host the first slice that would have to wait behind it.
+void Intellino_scheduler::route (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int *classified_multi_distance, int *classified_multi_category, int reject_distance)
+{
+	std::vector<std::future<void>> pending;
+	for (int first=0; first<multi_dataset_num; first+=split_rows) {
+		int n = multi_dataset_num - first < split_rows ? multi_dataset_num - first : split_rows;
+		long backlog = chip_backlog;
+		double chip_ns, cpu_ns;
+		{
+			std::lock_guard<std::mutex> lock(estimate_mutex);
+			chip_ns = chip_ns_per_vector;
+			cpu_ns = cpu_ns_per_vector;
+		}
+
+		bool on_chip;
+		if (chip_only)
+			on_chip = true;
+		else if (chip_ns == 0)
+			on_chip = backlog == 0 || cpu_ns != 0;
+		else if (cpu_ns == 0)
+			on_chip = backlog == 0;
+		else
+			on_chip = (backlog + n) * chip_ns <= n * cpu_ns;
+
+		if (on_chip) {
+			chip_backlog += n;
+			chip_vectors += n;
+			chip_slices++;
+			std::lock_guard<std::mutex> lock(chip_mutex);
+			if (!chip_thread.joinable())
+				chip_thread = std::thread(&Intellino_scheduler::chip_loop, this);
+			chip_jobs.push_back(Chip_job{n, vector_length, test_multi_data + first,
+						classified_multi_distance + first, classified_multi_category + first, std::promise<void>()});
+			pending.push_back(chip_jobs.back().done.get_future());
+			chip_cv.notify_one();
+		}
+		else {
+			cpu_vectors += n;
+			cpu_slices++;
+			classify_on_cpu(n, vector_length, test_multi_data + first,
+					classified_multi_distance + first, classified_multi_category + first, reject_distance);
+		}
+	}
+	for (std::future<void>& done : pending)
+		done.wait();
+}
+
+void Intellino_scheduler::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	route(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category, -1);
+}
+
+int Intellino_scheduler::classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	route(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category, reject_distance);
+	return reject_beyond(reject_distance, multi_dataset_num, classified_multi_distance, classified_multi_category);
+}
+
+// the shadow answers top-k on the host, the chip stays free for classify_multi
+void Intellino_scheduler::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	std::shared_lock<std::shared_mutex> lock(shadow_mutex);
+	for (int j=0; j<multi_dataset_num; j++)
+		shadow.classify_topk(vector_length, (const uint8_t*)test_multi_data[j], k,
+				classified_topk_distance + (size_t)j*k, classified_topk_category + (size_t)j*k);
+}
+
+Intellino_scheduler::Stats Intellino_scheduler::stats ()
+{
+	std::lock_guard<std::mutex> lock(estimate_mutex);
+	return Stats{chip_vectors, cpu_vectors, chip_slices, cpu_slices, chip_ns_per_vector, cpu_ns_per_vector};
+}
+
+void Intellino_scheduler::print_stats (FILE* fp)
+{
+	Stats s = stats();
+	fprintf(fp, "hybrid: chip %ld vectors / %ld slices (%.0f ns/vector), host %ld vectors / %ld slices (%.0f ns/vector)\n",
+		s.chip_vectors, s.chip_slices, s.chip_ns_per_vector, s.cpu_vectors, s.cpu_slices, s.cpu_ns_per_vector);
+}
@@ -0,0 +1,101 @@
+#ifndef INTELLINO_SCHEDULER_H
+#define INTELLINO_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include "intellino_classifier.h"
+#include "intellino_knn.h"
+
+// Hybrid chip / host classification. Every learn() goes to the chip and to a shadow
+// Intellino_knn, so the host can answer any query with the same result as the chip.
+// classify_multi() cuts the batch into slices of split_rows vectors; each slice is queued
+// for the chip unless the chip's backlog would finish later than the host could answer
+// it, in which case the calling thread runs it on the host engine right away.
+// Latencies are measured per slice and smoothed, so the split follows the live load.
+class Intellino_scheduler : public Intellino_classifier{
+private:
+    Intellino_classifier* chip;
+    Intellino_knn shadow;
+    mutable std::shared_mutex shadow_mutex;
+    int cpu_threads;
+    int split_rows;
+
+    // slices queued for the chip, run in order by chip_thread
+    struct Chip_job{
+        int multi_dataset_num;
+        int vector_length;
+        const char (*test_multi_data)[vector_max_len];
+        int *classified_multi_distance;
+        int *classified_multi_category;
+        std::promise<void> done;
+    };
+    std::thread chip_thread;
+    std::mutex chip_mutex;
+    std::condition_variable chip_cv;
+    std::deque<Chip_job> chip_jobs;
+    bool chip_stop = false;
+    std::mutex chip_busy;                 // held while chip_thread or a lone classify runs on the chip
+    void chip_loop ();
+
+    std::mutex estimate_mutex;
+    double chip_ns_per_vector = 0;    // 0 until measured
+    double cpu_ns_per_vector = 0;
+    std::atomic<long> chip_backlog{0};    // vectors queued or running on the chip
+    std::atomic<bool> chip_only{false};
+
+    std::atomic<long> chip_vectors{0};
+    std::atomic<long> cpu_vectors{0};
+    std::atomic<long> chip_slices{0};
+    std::atomic<long> cpu_slices{0};
+
+    void record (double* ns_per_vector, double elapsed_ns, int vectors);
+    void classify_on_cpu (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int *classified_multi_distance, int *classified_multi_category, int reject_distance);
+    void route (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int *classified_multi_distance, int *classified_multi_category, int reject_distance);
+
+public:
+    // takes ownership of chip; neuron_capacity must match the chip so the shadow drops
+    // the same overflow vectors (0 = unlimited); cpu_threads = 0 uses every hardware thread
+    Intellino_scheduler(Intellino_classifier* chip, int neuron_capacity = 0, int cpu_threads = 0, int split_rows = 256);
+    ~Intellino_scheduler();
+    Intellino_scheduler(const Intellino_scheduler&) = delete;
+    Intellino_scheduler& operator=(const Intellino_scheduler&) = delete;
+
+    // every slice to the chip queue, the host stays idle: the baseline a split run is timed against
+    void set_chip_only (bool on) { chip_only = on; }
+    void collect_metrics (Intellino_metrics& total) { chip->collect_metrics(total); }
+    void reset_metrics () { chip->reset_metrics(); }
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+    // host slices prune their search at the bound, chip slices are marked afterwards
+    int classify_multi_within (int reject_distance, int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+
+    struct Stats{
+        long chip_vectors;
+        long cpu_vectors;
+        long chip_slices;
+        long cpu_slices;
+        double chip_ns_per_vector;
+        double cpu_ns_per_vector;
+    };
+    Stats stats ();
+    void print_stats (FILE* fp);
+};
+
+#endif
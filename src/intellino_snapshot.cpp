@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "intellino_snapshot.h"
+
+static_assert(sizeof(Intellino_snapshot_header) == 64, "snapshot header must stay 64 bytes");
+
+static const int row_len = Intellino_snapshot::vector_max_len;
+
+// -------------------
+// CRC-32C
+// -------------------
+struct crc32c_table{
+	uint32_t entries[256];
+	crc32c_table() {
+		for (uint32_t i=0; i<256; i++) {
+			uint32_t crc = i;
+			for (int k=0; k<8; k++)
+				crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+			entries[i] = crc;
+		}
+	}
+};
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t* p, size_t len)
+{
+	static const crc32c_table table;
+	for (size_t i=0; i<len; i++)
+		crc = table.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len)
+{
+	uint64_t crc64 = crc;
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (uint32_t)crc64;
+	for (; len > 0; p++, len--)
+		crc = _mm_crc32_u8(crc, *p);
+	return crc;
+}
+#endif
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t* p, size_t len);
+
+static crc32c_fn select_crc32c()
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		return crc32c_sse42;
+#endif
+	return crc32c_scalar;
+}
+
+static const crc32c_fn crc32c_kernel = select_crc32c();
+
+uint32_t intellino_crc32c (uint32_t crc, const void* data, size_t len)
+{
+	return ~crc32c_kernel(~crc, (const uint8_t*)data, len);
+}
+
+// -------------------
+// Intellino_snapshot
+// -------------------
+void Intellino_snapshot::clear ()
+{
+	rows.clear();
+	lengths.clear();
+	categories.clear();
+}
+
+void Intellino_snapshot::record (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	record_multi(1, vector_length, (const char (*)[vector_max_len])learn_data, &learn_category);
+}
+
+void Intellino_snapshot::record_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	if (multi_dataset_num <= 0)
+		return;
+	if (vector_length > row_len)
+		vector_length = row_len;
+	size_t first = rows.size();
+	rows.resize(first + (size_t)multi_dataset_num*row_len, 0);
+	for (int j=0; j<multi_dataset_num; j++)
+		memcpy(&rows[first + (size_t)j*row_len], learn_multi_data[j], vector_length);
+	lengths.insert(lengths.end(), multi_dataset_num, (uint8_t)vector_length);
+	categories.insert(categories.end(), learn_multi_category, learn_multi_category + multi_dataset_num);
+}
+
+bool Intellino_snapshot::save (const char* path) const
+{
+	Intellino_snapshot_header header = {};
+	memcpy(header.magic, INTELLINO_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = INTELLINO_SNAPSHOT_VERSION;
+	header.row_stride = row_len;
+	header.count = lengths.size();
+	header.rows_offset = sizeof(Intellino_snapshot_header);
+	header.lengths_offset = header.rows_offset + rows.size();
+	header.categories_offset = header.lengths_offset + lengths.size();
+	uint32_t crc = intellino_crc32c(0, rows.data(), rows.size());
+	crc = intellino_crc32c(crc, lengths.data(), lengths.size());
+	header.checksum = intellino_crc32c(crc, categories.data(), categories.size());
+
+	std::string tmp = std::string(path) + ".tmp";
+	FILE* fp = fopen(tmp.c_str(), "wb");
+	if (fp == NULL)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fwrite(rows.data(), 1, rows.size(), fp) == rows.size()
+		&& fwrite(lengths.data(), 1, lengths.size(), fp) == lengths.size()
+		&& fwrite(categories.data(), 1, categories.size(), fp) == categories.size();
+	ok = (fclose(fp) == 0) && ok;
+	if (ok)
+		ok = rename(tmp.c_str(), path) == 0;
+	if (!ok)
+		remove(tmp.c_str());
+	return ok;
+}
+
+bool Intellino_snapshot::load (const char* path)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+		return false;
+
+	Intellino_snapshot_header header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+		&& memcmp(header.magic, INTELLINO_SNAPSHOT_MAGIC, sizeof(header.magic)) == 0
+		&& header.version == INTELLINO_SNAPSHOT_VERSION
+		&& header.row_stride == (uint32_t)row_len
+		&& header.rows_offset == sizeof(Intellino_snapshot_header)
+		&& header.lengths_offset == header.rows_offset + header.count*row_len
+		&& header.categories_offset == header.lengths_offset + header.count
+		&& header.count < (1ull << 31);
+	if (ok) {
+		rows.resize(header.count*row_len);
+		lengths.resize(header.count);
+		categories.resize(header.count);
+		ok = fread(rows.data(), 1, rows.size(), fp) == rows.size()
+			&& fread(lengths.data(), 1, lengths.size(), fp) == lengths.size()
+			&& fread(categories.data(), 1, categories.size(), fp) == categories.size();
+	}
+	fclose(fp);
+
+	if (ok) {
+		uint32_t crc = intellino_crc32c(0, rows.data(), rows.size());
+		crc = intellino_crc32c(crc, lengths.data(), lengths.size());
+		ok = intellino_crc32c(crc, categories.data(), categories.size()) == header.checksum;
+	}
+	for (size_t j=0; ok && j<lengths.size(); j++)
+		ok = lengths[j] > 0 && lengths[j] <= row_len;
+	if (!ok)
+		clear();
+	return ok;
+}
+
+void Intellino_snapshot::restore (Intellino_classifier& classifier) const
+{
+	const char (*vectors)[vector_max_len] = (const char (*)[vector_max_len])rows.data();
+	int count = size();
+	for (int first=0; first<count; ) {
+		int last = first + 1;
+		while (last < count && lengths[last] == lengths[first])
+			last++;
+		classifier.learn_multi(last - first, lengths[first], vectors + first, categories.data() + first);
+		first = last;
+	}
+}
+
+// -------------------
+// Intellino_recorder
+// -------------------
+Intellino_recorder::Intellino_recorder(Intellino_classifier* chip){
+	this->chip = chip;
+}
+
+Intellino_recorder::~Intellino_recorder(){
+	stop_async();
+	delete chip;
+}
+
+void Intellino_recorder::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	chip->learn(vector_length, learn_data, learn_category);
+	log.record(vector_length, learn_data, learn_category);
+}
+
+void Intellino_recorder::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	chip->learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	log.record_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+}
+
+void Intellino_recorder::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	chip->classify(vector_length, test_data, classified_distance, classified_category);
+}
+
+void Intellino_recorder::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	chip->classify_multi(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category);
+}
+
+void Intellino_recorder::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	chip->classify_topk(multi_dataset_num, vector_length, test_multi_data, k, classified_topk_distance, classified_topk_category);
+}
@@ -0,0 +1,86 @@
+#ifndef INTELLINO_SNAPSHOT_H
+#define INTELLINO_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "intellino_classifier.h"
+
+// Snapshot of learned vectors (*.snap), little endian:
+//   header (64 bytes)     Intellino_snapshot_header
+//   rows                  count x row_stride bytes, zero padded, in learn order
+//   vector lengths        count x uint8_t
+//   categories            count x uint8_t
+// checksum is the CRC-32C of every byte after the header.
+#define INTELLINO_SNAPSHOT_MAGIC	"INTLSNAP"
+#define INTELLINO_SNAPSHOT_VERSION	1
+
+struct Intellino_snapshot_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t row_stride;
+    uint64_t count;
+    uint64_t rows_offset;
+    uint64_t lengths_offset;
+    uint64_t categories_offset;
+    uint32_t checksum;
+    uint8_t reserved[12];
+};
+
+// In-memory log of learn calls that can be written to / read from a snapshot file
+// and replayed into any classifier.
+class Intellino_snapshot{
+private:
+    std::vector<char> rows;
+    std::vector<uint8_t> lengths;
+    std::vector<uint8_t> categories;
+
+public:
+    static const int vector_max_len = 64;
+
+    int size () const { return (int)lengths.size(); }
+    void clear ();
+    void record (int vector_length, const char* learn_data, uint8_t learn_category);
+    void record_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+
+    // save() writes <path>.tmp and renames it over path, so a crash never leaves a torn
+    // snapshot; load() is false if the file is missing, not a snapshot, truncated or corrupt
+    bool save (const char* path) const;
+    bool load (const char* path);
+
+    // learns every recorded vector in order, runs of equal length in one learn_multi()
+    void restore (Intellino_classifier& classifier) const;
+};
+
+// Forwards everything to the wrapped classifier and records each learn call.
+class Intellino_recorder : public Intellino_classifier{
+private:
+    Intellino_classifier* chip;
+    Intellino_snapshot log;
+
+public:
+    Intellino_recorder(Intellino_classifier* chip);   // takes ownership
+    ~Intellino_recorder();
+    Intellino_recorder(const Intellino_recorder&) = delete;
+    Intellino_recorder& operator=(const Intellino_recorder&) = delete;
+
+    Intellino_snapshot& snapshot() { return log; }
+
+    void collect_metrics (Intellino_metrics& total) { chip->collect_metrics(total); }
+    void reset_metrics () { chip->reset_metrics(); }
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+};
+
+// CRC-32C (Castagnoli), SSE4.2 crc32 instruction when the CPU has it
+uint32_t intellino_crc32c (uint32_t crc, const void* data, size_t len);
+
+#endif
@@ -9,7 +9,10 @@
 #include <linux/spi/spidev.h>
 #include <time.h>
 #include <stdarg.h>
+#include <string.h>
+#include <vector>
 #include "intellino_spi.h"  
+#include "intellino_emulator.h"
 
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))  
@@ -21,48 +24,53 @@ void pabort(const char *s)
     abort();  
 }  
   
-static const char *device = "/dev/spidev0.0";  
-static uint8_t mode = SPI_CPHA | SPI_CPOL; //SPI_MODE3
-static uint8_t bits = 8;  
-static uint32_t speed = 8000000;   // max speed = 8000000
-static uint16_t delay = 0;
-clock_t sum_clock = 0;
-
-void transfer(int fd, char* tx, char* rx, int len)
-{  
-    int ret;
-    struct spi_ioc_transfer tr[] = {  
-        {
-            .tx_buf = (unsigned long)tx,  
-            .rx_buf = (unsigned long)rx,  
-            .len = (__u32)len,  
-            .delay_usecs = delay,  
-            //.speed_hz = speed,  
-            .bits_per_word = bits,  
-        }
-    };
-	tr[0].speed_hz = speed;
- 
-    clock_t start = clock();
-    ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-    sum_clock += clock() - start;
-    if (ret < 1)
-        pabort("can't send spi message");
+static const char *default_device = "/dev/spidev0.0";  
+
+// spidev rejects any message whose tx (or rx) bytes add up to more than its bufsiz
+// module parameter (4096 by default), so big batches have to be cut into several ioctls.
+static int read_spidev_bufsiz()
+{
+	int bufsiz = 4096;
+	FILE *fp = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+	if (fp != NULL) {
+		if (fscanf(fp, "%d", &bufsiz) != 1 || bufsiz <= 0)
+			bufsiz = 4096;
+		fclose(fp);
+	}
+	return bufsiz;
 }
 
-// >>>>>>>>>> ================================================= //
-// ============= intellino PARAMETERS & FUNCTIONS ============= //
-// ============================================================ //
-#define	LEARN_COMMAND			0x60
-#define	CLASSIFY_COMMAND		0x40
-#define	READ_DISTANCE			0x83
-#define	READ_CATEGORY			0x84
-#define	DUMMY				0x00
+// -------------------
+// configuration
+// -------------------
+Intellino_spi_config intellino_spi_config(const char* device)
+{
+	Intellino_spi_config config;
+	if (device != NULL)
+		config.device = device;
+	const char* hz = getenv("INTELLINO_SPI_HZ");
+	if (hz && atol(hz) > 0)
+		config.speed_hz = (uint32_t)atol(hz);
+	const char* spi_mode = getenv("INTELLINO_SPI_MODE");
+	if (spi_mode)
+		config.mode = (uint8_t)(atoi(spi_mode) & (SPI_CPHA | SPI_CPOL));
+	const char* delay_us = getenv("INTELLINO_SPI_DELAY_US");
+	if (delay_us)
+		config.delay_usecs = (uint16_t)atoi(delay_us);
+	return config;
+}
 
-Intellino_spi::Intellino_spi(){
+// -------------------
+// spidev transport
+// -------------------
+Spidev_transport::Spidev_transport(const Intellino_spi_config& config){
 	int ret = 0;
+	this->mode = config.mode;
+	this->bits = config.bits;
+	this->speed = config.speed_hz;
+	this->delay = config.delay_usecs;
 
-    int fd = open(device, O_RDWR);  
+    int fd = open(config.device.c_str(), O_RDWR);  
 	this->spi_fd = fd;
     if (fd < 0)  
         pabort("can't open device");  
@@ -103,105 +111,428 @@ Intellino_spi::Intellino_spi(){
     printf("spi mode: %d\n", mode);  
     printf("bits per word: %d\n", bits);  
     printf("max speed: %d Hz (%d KHz)\n", speed, speed/1000);  
+
+	this->bufsiz = read_spidev_bufsiz();
+	printf("spidev bufsiz: %d bytes\n", this->bufsiz);
+
+	const char* topk = getenv("INTELLINO_CHIP_TOPK");
+	this->walks_winners = topk && atoi(topk);
+}
+
+Spidev_transport::~Spidev_transport(){
+	if (spi_fd >= 0)
+		close(spi_fd);
+	delete[] segments;
+}
+
+// A refused clock leaves the previous one in place.
+bool Spidev_transport::set_speed_hz(uint32_t hz)
+{
+	uint32_t applied = hz;
+	if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &applied) == -1)
+		return false;
+	if (ioctl(spi_fd, SPI_IOC_RD_MAX_SPEED_HZ, &applied) == -1 || applied != hz) {
+		ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+		return false;
+	}
+	speed = hz;
+	return true;
+}
+
+void Spidev_transport::transfer(char* tx, char* rx, int len)
+{
+	transfer_frames(tx, rx, 1, len);
+}
+
+// ------------------------------
+// batched transfer
+// ------------------------------
+// Splits frames into as few SPI_IOC_MESSAGE(N) ioctls as bufsiz allows. A frame never
+// straddles two ioctls (chip select is released between messages), and each
+// spi_ioc_transfer segment stays below max_segment_len for the controller.
+// Raising spidev.bufsiz (e.g. spidev.bufsiz=65536 on the kernel command line) lets
+// one ioctl carry many segments and cuts the syscall count accordingly.
+void Spidev_transport::transfer_frames(char* tx, char* rx, int frame_len, int frames)
+{
+	int frames_per_message = bufsiz / frame_len;
+	if (frames_per_message < 1)
+		frames_per_message = 1;
+	int frames_per_segment = max_segment_len / frame_len;
+	if (frames_per_segment < 1)
+		frames_per_segment = 1;
+	if (frames_per_segment > frames_per_message)
+		frames_per_segment = frames_per_message;
+
+	int max_segments = (frames_per_message + frames_per_segment - 1) / frames_per_segment;
+	if (max_segments > segments_reserved) {
+		delete[] segments;
+		segments = new spi_ioc_transfer[max_segments];
+		segments_reserved = max_segments;
+	}
+
+	while (frames > 0) {
+		int message_frames = frames < frames_per_message ? frames : frames_per_message;
+		int n = 0;
+		for (int done = 0; done < message_frames; n++) {
+			int segment_frames = message_frames - done;
+			if (segment_frames > frames_per_segment)
+				segment_frames = frames_per_segment;
+			size_t offset = (size_t)frame_len*done;
+
+			memset(&segments[n], 0, sizeof(segments[n]));
+			segments[n].tx_buf = (unsigned long)(tx + offset);
+			segments[n].rx_buf = (unsigned long)(rx + offset);
+			segments[n].len = (__u32)(frame_len*segment_frames);
+			segments[n].delay_usecs = delay;
+			segments[n].speed_hz = speed;
+			segments[n].bits_per_word = bits;
+			done += segment_frames;
+		}
+
+		int ret = ioctl(spi_fd, SPI_IOC_MESSAGE(n), segments);
+		message_count++;
+		if (ret < 1)
+			pabort("can't send spi message");
+
+		size_t sent = (size_t)frame_len*message_frames;
+		tx += sent;
+		rx += sent;
+		frames -= message_frames;
+	}
+}
+
+Intellino_transport* intellino_open_transport(const Intellino_spi_config& config)
+{
+	const char* device = config.device.c_str();
+	if (strncmp(device, "emu", 3) == 0 && (device[3] == '\0' || device[3] == ':')) {
+		Intellino_emulator* emulator = new Intellino_emulator(device[3] == ':' ? atoi(device + 4) : 0);
+		emulator->set_speed_hz(config.speed_hz);
+		return emulator;
+	}
+	return new Spidev_transport(config);
+}
+
+Intellino_transport* intellino_open_transport(const char* device)
+{
+	return intellino_open_transport(intellino_spi_config(device));
+}
+
+// >>>>>>>>>> ================================================= //
+// ============= intellino PARAMETERS & FUNCTIONS ============= //
+// ============================================================ //
+// command bytes live in intellino_transport.h (shared with the emulator)
+
+// INTELLINO_DEVICE selects the backend, e.g. INTELLINO_DEVICE=emu ./app.out
+Intellino_spi::Intellino_spi(){
+	const char* device = getenv("INTELLINO_DEVICE");
+	this->transport = intellino_open_transport(device ? device : default_device);
+}
+
+Intellino_spi::Intellino_spi(Intellino_transport* transport, int neuron_capacity, bool host_topk){
+	this->transport = transport;
+	if (host_topk && !transport->repeated_reads())
+		shadow = new Intellino_knn(neuron_capacity);
+}
+
+Intellino_spi::Intellino_spi(const Intellino_spi_config& config, int neuron_capacity, bool host_topk)
+	: Intellino_spi(intellino_open_transport(config), neuron_capacity, host_topk) {}
+
+Intellino_spi::~Intellino_spi(){
+	stop_async();
+	delete shadow;
+	delete transport;
 }
 
 
+// Frames carry 1 .. vector_max_len payload bytes and rows are vector_max_len bytes apart:
+// longer vectors are cut to vector_max_len, as on Intellino_knn. An empty vector is never
+// sent; classify calls answer it as a missing winner (max_distance, category 0).
+static bool fit_length (int& vector_length)
+{
+	if (vector_length > Intellino_classifier::vector_max_len)
+		vector_length = Intellino_classifier::vector_max_len;
+	return vector_length >= 1;
+}
+
+static void no_answers (size_t answers, int *classified_distance, int *classified_category)
+{
+	for (size_t j=0; j<answers; j++) {
+		classified_distance[j] = Intellino_classifier::max_distance;
+		classified_category[j] = 0;
+	}
+}
+
 // -------------------
 // intellino LEARN
 // -------------------
-void Intellino_spi::learn (int vector_length, char* learn_data, uint8_t learn_category)
+void Intellino_spi::learn (int vector_length, const char* learn_data, uint8_t learn_category)
 {
-	char learn_tx_buf[vector_length+4];
-	char learn_rx_buf[vector_length+4];
-
-	for (int i=0; i<vector_length+3; i++) {
-		switch(i) {
-			case 0			:	learn_tx_buf[i] = LEARN_COMMAND;
-							break;
-			case 1			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) >> 8);
-							break;
-			case 2			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) & 0x00FF);
-							break;
-			default			:	learn_tx_buf[i] = learn_data[i-3];
-							break;
-		}
+	if (!fit_length(vector_length))
+		return;
+	if (vector_length == vector_max_len) {
+		learn_fixed<vector_max_len>(Intellino_metrics::LEARN, 1, (const uint8_t*)learn_data, vector_max_len, &learn_category);
+		return;
 	}
-	learn_tx_buf[vector_length+3] = learn_category;
+	std::lock_guard<std::mutex> lock(bus_mutex);
+	long messages = transport->messages();
+	auto start = Intellino_metrics::clock::now();
+	int len = learn_frames.encode_learn(vector_length, learn_data, learn_category);
+	auto encoded = Intellino_metrics::clock::now();
+
+	transport->transfer(learn_frames.tx_buf(), learn_frames.rx_buf(), len);
+	auto end = Intellino_metrics::clock::now();
 
-	transfer(this->spi_fd, learn_tx_buf, learn_rx_buf, vector_length+4);
+	op_metrics.record(Intellino_metrics::LEARN, Intellino_metrics::ENCODE, start, encoded);
+	op_metrics.record(Intellino_metrics::LEARN, Intellino_metrics::TRANSFER, encoded, end);
+	op_metrics.record(Intellino_metrics::LEARN, Intellino_metrics::TOTAL, start, end);
+	op_metrics.count(Intellino_metrics::LEARN, 1, len, transport->messages() - messages);
+	if (shadow)
+		shadow->learn(vector_length, (const uint8_t*)learn_data, learn_category);
+}
+
+// ------------------------
+// intellino LEARN_MULTI
+// ------------------------
+// All LEARN frames go out back to back through transfer_frames, so spidev packs them
+// into chained segments of bufsiz-sized ioctls instead of one ioctl per vector.
+void Intellino_spi::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	if (multi_dataset_num <= 0 || !fit_length(vector_length))
+		return;
+	if (vector_length == vector_max_len) {
+		learn_fixed<vector_max_len>(Intellino_metrics::LEARN_MULTI, multi_dataset_num, (const uint8_t*)learn_multi_data, vector_max_len,
+						learn_multi_category);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(bus_mutex);
+	long messages = transport->messages();
+	auto start = Intellino_metrics::clock::now();
+	int frame_len = learn_frame_len(vector_length);
+	learn_frames.encode_learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	auto encoded = Intellino_metrics::clock::now();
+
+	transport->transfer_frames(learn_frames.tx_buf(), learn_frames.rx_buf(), frame_len, multi_dataset_num);
+	auto end = Intellino_metrics::clock::now();
+
+	op_metrics.record(Intellino_metrics::LEARN_MULTI, Intellino_metrics::ENCODE, start, encoded);
+	op_metrics.record(Intellino_metrics::LEARN_MULTI, Intellino_metrics::TRANSFER, encoded, end);
+	op_metrics.record(Intellino_metrics::LEARN_MULTI, Intellino_metrics::TOTAL, start, end);
+	op_metrics.count(Intellino_metrics::LEARN_MULTI, multi_dataset_num, (long)frame_len*multi_dataset_num, transport->messages() - messages);
+	for (int j=0; shadow && j<multi_dataset_num; j++)
+		shadow->learn(vector_length, (const uint8_t*)learn_multi_data[j], learn_multi_category[j]);
 }
 
 // -------------------
 // intellino CLASSIFY
 // -------------------
-void Intellino_spi::classify (int vector_length, char* test_data, int *classified_distance, int *classified_category)
+void Intellino_spi::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
 {
-	char learn_tx_buf[vector_length+11];
-	char learn_rx_buf[vector_length+11];
-
-	for (int i=0; i<vector_length+3; i++) {
-		switch(i) {
-			case 0			:	learn_tx_buf[i] = CLASSIFY_COMMAND;
-							break;
-			case 1			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) >> 8);
-							break;
-			case 2			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) & 0x00FF);
-							break;
-			default			:	learn_tx_buf[i] = test_data[i-3];
-							break;
-		}
+	if (!fit_length(vector_length)) {
+		no_answers(1, classified_distance, classified_category);
+		return;
+	}
+	if (vector_length == vector_max_len) {
+		classify_fixed<vector_max_len>(Intellino_metrics::CLASSIFY, 1, (const uint8_t*)test_data, vector_max_len,
+						classified_distance, classified_category);
+		return;
 	}
-	learn_tx_buf[vector_length+3] = READ_DISTANCE;
-	learn_tx_buf[vector_length+4] = DUMMY;
-	learn_tx_buf[vector_length+5] = DUMMY;
-	learn_tx_buf[vector_length+6] = DUMMY;
-	learn_tx_buf[vector_length+7] = READ_CATEGORY;
-	learn_tx_buf[vector_length+8] = DUMMY;
-	learn_tx_buf[vector_length+9] = DUMMY;
-	learn_tx_buf[vector_length+10] = DUMMY;
+	std::lock_guard<std::mutex> lock(bus_mutex);
+	long messages = transport->messages();
+	auto start = Intellino_metrics::clock::now();
+	int len = classify_frames.encode_classify(1, vector_length, (const char (*)[vector_max_len])test_data);
+	auto encoded = Intellino_metrics::clock::now();
 
-	transfer(this->spi_fd, learn_tx_buf, learn_rx_buf, vector_length+11);
+	transport->transfer(classify_frames.tx_buf(), classify_frames.rx_buf(), len);
+	auto transferred = Intellino_metrics::clock::now();
 
-	*classified_distance = (learn_rx_buf[vector_length+5]<<8) + learn_rx_buf[vector_length+6];
-	*classified_category = (learn_rx_buf[vector_length+9]<<8) + learn_rx_buf[vector_length+10];
+	const uint8_t* rx = classify_frames.rx_frame(len, 0);
+	*classified_distance = decode_u16(rx + classify_distance_offset(vector_length));
+	*classified_category = decode_u16(rx + classify_category_offset(vector_length));
+	auto end = Intellino_metrics::clock::now();
+
+	op_metrics.record(Intellino_metrics::CLASSIFY, Intellino_metrics::ENCODE, start, encoded);
+	op_metrics.record(Intellino_metrics::CLASSIFY, Intellino_metrics::TRANSFER, encoded, transferred);
+	op_metrics.record(Intellino_metrics::CLASSIFY, Intellino_metrics::DECODE, transferred, end);
+	op_metrics.record(Intellino_metrics::CLASSIFY, Intellino_metrics::TOTAL, start, end);
+	op_metrics.count(Intellino_metrics::CLASSIFY, 1, len, transport->messages() - messages);
 }
 
 // ------------------------
 // intellino CLASSIFY_MULTI
 // ------------------------
 void Intellino_spi::classify_multi (int multi_dataset_num, int vector_length,
-					char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
 {
-	char learn_tx_buf[(vector_length+11)*multi_dataset_num];
-	char learn_rx_buf[(vector_length+11)*multi_dataset_num];
+	if (multi_dataset_num <= 0)
+		return;
+	if (!fit_length(vector_length)) {
+		no_answers(multi_dataset_num, classified_multi_distance, classified_multi_category);
+		return;
+	}
+	if (vector_length == vector_max_len) {
+		classify_fixed<vector_max_len>(Intellino_metrics::CLASSIFY_MULTI, multi_dataset_num, (const uint8_t*)test_multi_data, vector_max_len,
+						classified_multi_distance, classified_multi_category);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(bus_mutex);
+	long messages = transport->messages();
+	auto start = Intellino_metrics::clock::now();
+	int frame_len = classify_frame_len(vector_length);
+	classify_frames.encode_classify(multi_dataset_num, vector_length, test_multi_data);
+	auto encoded = Intellino_metrics::clock::now();
+
+	transport->transfer_frames(classify_frames.tx_buf(), classify_frames.rx_buf(), frame_len, multi_dataset_num);
+	auto transferred = Intellino_metrics::clock::now();
 
 	for (int j=0; j<multi_dataset_num; j++) {
-		for (int i=0; i<vector_length+3; i++) {
-			switch(i) {
-				case 0			:	learn_tx_buf[(vector_length+11)*j+i] = CLASSIFY_COMMAND;
-								break;
-				case 1			:	learn_tx_buf[(vector_length+11)*j+i] = (uint8_t)((vector_length-1) >> 8);
-								break;
-				case 2			:	learn_tx_buf[(vector_length+11)*j+i] = (uint8_t)((vector_length-1) & 0x00FF);
-								break;
-				default			:	learn_tx_buf[(vector_length+11)*j+i] = test_multi_data[j][i-3];
-								break;
+		const uint8_t* rx = classify_frames.rx_frame(frame_len, j);
+		classified_multi_distance[j] = decode_u16(rx + classify_distance_offset(vector_length));
+		classified_multi_category[j] = decode_u16(rx + classify_category_offset(vector_length));
+	}
+	auto end = Intellino_metrics::clock::now();
+
+	op_metrics.record(Intellino_metrics::CLASSIFY_MULTI, Intellino_metrics::ENCODE, start, encoded);
+	op_metrics.record(Intellino_metrics::CLASSIFY_MULTI, Intellino_metrics::TRANSFER, encoded, transferred);
+	op_metrics.record(Intellino_metrics::CLASSIFY_MULTI, Intellino_metrics::DECODE, transferred, end);
+	op_metrics.record(Intellino_metrics::CLASSIFY_MULTI, Intellino_metrics::TOTAL, start, end);
+	op_metrics.count(Intellino_metrics::CLASSIFY_MULTI, multi_dataset_num, (long)frame_len*multi_dataset_num, transport->messages() - messages);
+}
+
+// ------------------------
+// intellino CLASSIFY_TOPK
+// ------------------------
+// Chips with repeated_reads() get k READ_DISTANCE / READ_CATEGORY pairs after each
+// CLASSIFY, all frames in one transfer_frames. Otherwise the host copy answers with a
+// partial sort, without touching the bus, or, without one, a classify_multi answers the
+// winner and the other k - 1 read as missing.
+void Intellino_spi::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	if (multi_dataset_num <= 0 || k <= 0)
+		return;
+	if (!fit_length(vector_length)) {
+		no_answers((size_t)multi_dataset_num*k, classified_topk_distance, classified_topk_category);
+		return;
+	}
+	if (!shadow && !transport->repeated_reads()) {
+		if (k > 1)
+			std::call_once(topk_warning, []{ fprintf(stderr, "intellino: chip answers only its winner, "
+							"open it with host_topk (INTELLINO_HOST_TOPK=1) for classify_topk\n"); });
+		std::vector<int> distance(multi_dataset_num), category(multi_dataset_num);
+		classify_multi(multi_dataset_num, vector_length, test_multi_data, distance.data(), category.data());
+		for (int j=0; j<multi_dataset_num; j++) {
+			for (int r=0; r<k; r++) {
+				classified_topk_distance[(size_t)j*k + r] = r == 0 ? distance[j] : max_distance;
+				classified_topk_category[(size_t)j*k + r] = r == 0 ? category[j] : 0;
 			}
 		}
-		learn_tx_buf[(vector_length+11)*j+(vector_length+3)] = READ_DISTANCE;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+4)] = DUMMY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+5)] = DUMMY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+6)] = DUMMY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+7)] = READ_CATEGORY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+8)] = DUMMY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+9)] = DUMMY;
-		learn_tx_buf[(vector_length+11)*j+(vector_length+10)] = DUMMY;
+		return;
 	}
+	std::lock_guard<std::mutex> lock(bus_mutex);
+	long messages = transport->messages();
+	auto start = Intellino_metrics::clock::now();
 
-	transfer(this->spi_fd, learn_tx_buf, learn_rx_buf, (vector_length+11)*multi_dataset_num);
+	if (shadow) {
+		for (int j=0; j<multi_dataset_num; j++)
+			shadow->classify_topk(vector_length, (const uint8_t*)test_multi_data[j], k,
+					classified_topk_distance + (size_t)j*k, classified_topk_category + (size_t)j*k);
+		op_metrics.record(Intellino_metrics::CLASSIFY_TOPK, Intellino_metrics::TOTAL, start, Intellino_metrics::clock::now());
+		op_metrics.count(Intellino_metrics::CLASSIFY_TOPK, multi_dataset_num, 0, 0);
+		return;
+	}
+
+	int frame_len = classify_frame_len(vector_length, k);
+	classify_frames.encode_classify(multi_dataset_num, vector_length, test_multi_data, k);
+	auto encoded = Intellino_metrics::clock::now();
+
+	transport->transfer_frames(classify_frames.tx_buf(), classify_frames.rx_buf(), frame_len, multi_dataset_num);
+	auto transferred = Intellino_metrics::clock::now();
 
 	for (int j=0; j<multi_dataset_num; j++) {
-		classified_multi_distance[j] = (learn_rx_buf[(vector_length+11)*j+(vector_length+5)]<<8) + learn_rx_buf[(vector_length+11)*j+(vector_length+6)];
-		classified_multi_category[j] = (learn_rx_buf[(vector_length+11)*j+(vector_length+9)]<<8) + learn_rx_buf[(vector_length+11)*j+(vector_length+10)];
+		const uint8_t* rx = classify_frames.rx_frame(frame_len, j);
+		for (int r=0; r<k; r++) {
+			classified_topk_distance[(size_t)j*k + r] = decode_u16(rx + classify_distance_offset(vector_length, r));
+			classified_topk_category[(size_t)j*k + r] = decode_u16(rx + classify_category_offset(vector_length, r));
+		}
+	}
+	auto end = Intellino_metrics::clock::now();
+
+	op_metrics.record(Intellino_metrics::CLASSIFY_TOPK, Intellino_metrics::ENCODE, start, encoded);
+	op_metrics.record(Intellino_metrics::CLASSIFY_TOPK, Intellino_metrics::TRANSFER, encoded, transferred);
+	op_metrics.record(Intellino_metrics::CLASSIFY_TOPK, Intellino_metrics::DECODE, transferred, end);
+	op_metrics.record(Intellino_metrics::CLASSIFY_TOPK, Intellino_metrics::TOTAL, start, end);
+	op_metrics.count(Intellino_metrics::CLASSIFY_TOPK, multi_dataset_num, (long)frame_len*multi_dataset_num, transport->messages() - messages);
+}
+
+// ------------------------
+// clock calibration
+// ------------------------
+// Each probe is queried as itself (distance 0) and with one byte moved by a known amount
+// (distance = that amount), so corrupted payload bits and corrupted distance / category
+// bits both show up as a wrong answer. Probes taken from learned_rows are only queried as
+// themselves: a near miss could land closer to some other learned row. The first failing
+// step ends the search: signal integrity only gets worse with a faster clock.
+uint32_t Intellino_spi::calibrate_speed (const Intellino_calibration& calibration)
+{
+	uint32_t speed = transport->speed_hz();
+	int probes = calibration.probes;
+	if (speed == 0 || probes <= 0)
+		return speed;
+
+	std::vector<char> rows((size_t)2*probes*vector_max_len);
+	char (*queries)[vector_max_len] = (char (*)[vector_max_len])rows.data();
+	std::vector<int> expected(2*probes), expected_category(2*probes, calibration.probe_category);
+	int vector_length = vector_max_len;
+	int count = 2*probes;
+	if (calibration.learned_rows) {
+		vector_length = calibration.learned_length;
+		if (!fit_length(vector_length))
+			return 0;
+		memcpy(queries, calibration.learned_rows, (size_t)probes*vector_max_len);
+		for (int j=0; j<probes; j++)
+			expected_category[j] = calibration.learned_categories[j];
+		count = probes;
 	}
-}
\ No newline at end of file
+	else {
+		uint32_t seed = 0x9E3779B9;
+		for (int j=0; j<probes; j++) {
+			for (int i=0; i<vector_max_len; i++) {
+				seed = seed*1664525 + 1013904223;
+				queries[j][i] = (char)(seed >> 24);
+			}
+			// a few all-ones / alternating bytes exercise every data line
+			queries[j][j % vector_max_len] = (char)(j & 1 ? 0xAA : 0xFF);
+			memcpy(queries[probes + j], queries[j], vector_max_len);
+			uint8_t value = (uint8_t)queries[j][(j + 1) % vector_max_len];
+			int delta = 1 + j % 15;
+			queries[probes + j][(j + 1) % vector_max_len] = (char)(value < 128 ? value + delta : value - delta);
+			expected[probes + j] = delta;
+		}
+		std::vector<uint8_t> categories(probes, calibration.probe_category);
+		learn_multi(probes, vector_max_len, queries, categories.data());
+	}
+
+	std::vector<int> distance(count), category(count);
+	auto verified = [&]() {
+		for (int round=0; round<calibration.rounds; round++) {
+			classify_multi(count, vector_length, queries, distance.data(), category.data());
+			for (int j=0; j<count; j++)
+				if (distance[j] != expected[j] || category[j] != expected_category[j])
+					return false;
+		}
+		return true;
+	};
+
+	uint32_t reliable = speed;
+	if (!verified())
+		return 0;
+	for (uint32_t hz = speed + calibration.step_hz; hz <= calibration.max_hz && hz > reliable; hz += calibration.step_hz) {
+		if (!transport->set_speed_hz(hz) || !verified())
+			break;
+		reliable = hz;
+	}
+	if (transport->speed_hz() != reliable)
+		transport->set_speed_hz(reliable);
+	return reliable;
+}
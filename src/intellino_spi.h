@@ -1,15 +1,162 @@
+#ifndef INTELLINO_SPI_H
+#define INTELLINO_SPI_H
+
+#include <stddef.h>
 #include <stdint.h>
-#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0])) 
+#include <array>
+#include <mutex>
+#include "intellino_classifier.h"
+#include "intellino_transport.h"
+#include "intellino_frame.h"
+#include "intellino_knn.h"
+#include "intellino_metrics.h"
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// Intellino_spi::calibrate_speed() raises the clock from the current one by step_hz up to
+// max_hz and checks each step with `rounds` classify_multi calls over `probes` known
+// vectors (exact matches and near misses with known distances).
+// With learned_rows set the probes are the first `probes` of those rows instead, already on
+// the chip under learned_categories and distinct from every other learned row: each is
+// queried as itself (distance 0, its own category) and nothing is learned.
+struct Intellino_calibration{
+    uint32_t max_hz = 50000000;
+    uint32_t step_hz = 2000000;
+    int probes = 16;
+    int rounds = 4;
+    uint8_t probe_category = 0xFF;
+    const char (*learned_rows)[Intellino_classifier::vector_max_len] = nullptr;
+    const uint8_t* learned_categories = nullptr;
+    int learned_length = Intellino_classifier::vector_max_len;
+};
 
-class Intellino_spi{
+class Intellino_spi : public Intellino_classifier{
 private:
-    int spi_fd = 0;
+    Intellino_transport* transport = nullptr;
+    Intellino_frame_arena learn_frames;
+    Intellino_frame_arena classify_frames;
+    std::mutex bus_mutex;          // one frame sequence on the bus at a time
+    Intellino_metrics op_metrics;
+    Intellino_knn* shadow = nullptr;  // host copy for classify_topk when the chip can't walk its winners
+    std::once_flag topk_warning;
+
+    // compile-time vector length paths, rows are stride bytes apart
+    template <int N>
+    void learn_fixed (Intellino_metrics::Op op, int multi_dataset_num, const uint8_t* rows, size_t stride, const uint8_t* categories);
+    template <int N>
+    void classify_fixed (Intellino_metrics::Op op, int multi_dataset_num, const uint8_t* rows, size_t stride,
+                int *classified_distance, int *classified_category);
 
 public:
-    static const int vector_max_len = 64;
     Intellino_spi();
-    void learn (int vector_length, char* learn_data, uint8_t learn_category);
-    void classify (int vector_length, char* test_data, int *classified_distance, int *classified_category);
+    // Takes ownership. On transports without repeated_reads(), host_topk keeps a host copy
+    // of every learned vector (64 bytes each, neuron_capacity of them, 0 = unlimited) so
+    // classify_topk can rank past the chip's own winner; without it classify_topk answers
+    // the winner alone. Scheduler and verifier front ends keep copies of their own.
+    Intellino_spi(Intellino_transport* transport, int neuron_capacity = 0, bool host_topk = false);
+    Intellino_spi(const Intellino_spi_config& config, int neuron_capacity = 0, bool host_topk = false);
+    ~Intellino_spi();
+    Intellino_spi(const Intellino_spi&) = delete;
+    Intellino_spi& operator=(const Intellino_spi&) = delete;
+    // latency histograms and throughput of every call on this chip
+    Intellino_metrics& metrics() { return op_metrics; }
+    void collect_metrics (Intellino_metrics& total) { total.add(op_metrics); }
+    void reset_metrics () { op_metrics.reset(); }
+
+    uint32_t speed_hz () const { return transport->speed_hz(); }
+    bool set_speed_hz (uint32_t hz) { return transport->set_speed_hz(hz); }
+    // Leaves the bus on the fastest step that answered every probe correctly and returns
+    // it; 0 if the transport has no clock or the starting clock already fails. The probe
+    // vectors are learned once, at the starting clock, and stay on the chip, where any
+    // later classify can answer probe_category: calibrate a freshly reset chip and reset it
+    // again before training, or calibrate after training with learned_rows.
+    uint32_t calibrate_speed (const Intellino_calibration& calibration = Intellino_calibration());
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
     void classify_multi (int multi_dataset_num, int vector_length,
-                char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
-};
\ No newline at end of file
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+
+    // vector length from the type: frame layout fixed at compile time. The runtime-length
+    // calls above take the same path for vector_max_len vectors.
+    template <size_t N>
+    void learn (const std::array<uint8_t, N>& learn_data, uint8_t learn_category)
+    {
+        static_assert(N >= 1 && N <= vector_max_len, "vector length must fit a chip row");
+        learn_fixed<N>(Intellino_metrics::LEARN, 1, learn_data.data(), N, &learn_category);
+    }
+    template <size_t N>
+    void learn_multi (int multi_dataset_num, const std::array<uint8_t, N>* learn_multi_data, const uint8_t* learn_multi_category)
+    {
+        static_assert(N >= 1 && N <= vector_max_len, "vector length must fit a chip row");
+        learn_fixed<N>(Intellino_metrics::LEARN_MULTI, multi_dataset_num, learn_multi_data[0].data(), sizeof(learn_multi_data[0]),
+                learn_multi_category);
+    }
+    template <size_t N>
+    void classify (const std::array<uint8_t, N>& test_data, int *classified_distance, int *classified_category)
+    {
+        static_assert(N >= 1 && N <= vector_max_len, "vector length must fit a chip row");
+        classify_fixed<N>(Intellino_metrics::CLASSIFY, 1, test_data.data(), N, classified_distance, classified_category);
+    }
+    template <size_t N>
+    void classify_multi (int multi_dataset_num, const std::array<uint8_t, N>* test_multi_data,
+                int *classified_multi_distance, int *classified_multi_category)
+    {
+        static_assert(N >= 1 && N <= vector_max_len, "vector length must fit a chip row");
+        classify_fixed<N>(Intellino_metrics::CLASSIFY_MULTI, multi_dataset_num, test_multi_data[0].data(), sizeof(test_multi_data[0]),
+                classified_multi_distance, classified_multi_category);
+    }
+};
+
+template <int N>
+void Intellino_spi::learn_fixed (Intellino_metrics::Op op, int multi_dataset_num, const uint8_t* rows, size_t stride,
+                const uint8_t* categories)
+{
+    if (multi_dataset_num <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(bus_mutex);
+    long messages = transport->messages();
+    auto start = Intellino_metrics::clock::now();
+    int len = learn_frames.encode_learn_fixed<N>(multi_dataset_num, rows, stride, categories);
+    auto encoded = Intellino_metrics::clock::now();
+
+    transport->transfer_frames(learn_frames.tx_buf(), learn_frames.rx_buf(), Intellino_frame_layout<N>::learn_len, multi_dataset_num);
+    auto end = Intellino_metrics::clock::now();
+
+    op_metrics.record(op, Intellino_metrics::ENCODE, start, encoded);
+    op_metrics.record(op, Intellino_metrics::TRANSFER, encoded, end);
+    op_metrics.record(op, Intellino_metrics::TOTAL, start, end);
+    op_metrics.count(op, multi_dataset_num, len, transport->messages() - messages);
+    for (int j=0; shadow && j<multi_dataset_num; j++)
+        shadow->learn(N, rows + stride*j, categories[j]);
+}
+
+template <int N>
+void Intellino_spi::classify_fixed (Intellino_metrics::Op op, int multi_dataset_num, const uint8_t* rows, size_t stride,
+                int *classified_distance, int *classified_category)
+{
+    if (multi_dataset_num <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(bus_mutex);
+    long messages = transport->messages();
+    auto start = Intellino_metrics::clock::now();
+    int len = classify_frames.encode_classify_fixed<N>(multi_dataset_num, rows, stride);
+    auto encoded = Intellino_metrics::clock::now();
+
+    transport->transfer_frames(classify_frames.tx_buf(), classify_frames.rx_buf(), Intellino_frame_layout<N>::classify_len, multi_dataset_num);
+    auto transferred = Intellino_metrics::clock::now();
+
+    decode_classify_fixed<N>((const uint8_t*)classify_frames.rx_buf(), multi_dataset_num, classified_distance, classified_category);
+    auto end = Intellino_metrics::clock::now();
+
+    op_metrics.record(op, Intellino_metrics::ENCODE, start, encoded);
+    op_metrics.record(op, Intellino_metrics::TRANSFER, encoded, transferred);
+    op_metrics.record(op, Intellino_metrics::DECODE, transferred, end);
+    op_metrics.record(op, Intellino_metrics::TOTAL, start, end);
+    op_metrics.count(op, multi_dataset_num, len, transport->messages() - messages);
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef INTELLINO_TRANSPORT_H
+#define INTELLINO_TRANSPORT_H
+
+#include <stdint.h>
+#include <string>
+
+// intellino SPI command bytes
+#define	LEARN_COMMAND			0x60
+#define	CLASSIFY_COMMAND		0x40
+#define	READ_DISTANCE			0x83
+#define	READ_CATEGORY			0x84
+#define	DUMMY				0x00
+
+// Byte-level full-duplex link to an Intellino.
+// Every byte clocked out of tx clocks one byte back into rx, exactly like SPI.
+class Intellino_transport{
+public:
+    virtual ~Intellino_transport() {}
+    virtual void transfer(char* tx, char* rx, int len) = 0;
+    // frames back-to-back frames of frame_len bytes; a transport may split between frames, never inside one
+    virtual void transfer_frames(char* tx, char* rx, int frame_len, int frames) { transfer(tx, rx, frame_len*frames); }
+    // true if READ_DISTANCE / READ_CATEGORY repeated after one CLASSIFY walk down the
+    // winners (2nd closest, 3rd, ...) instead of repeating the first
+    virtual bool repeated_reads() const { return false; }
+    // bus messages (spidev ioctls) issued so far
+    long messages() const { return message_count; }
+    // SPI clock; set_speed_hz() is false if the link refused it (the old clock stays)
+    virtual uint32_t speed_hz() const { return 0; }
+    virtual bool set_speed_hz(uint32_t) { return false; }
+
+protected:
+    long message_count = 0;
+};
+
+struct spi_ioc_transfer;
+
+// How to open and clock one device. intellino_spi_config(device) starts from these
+// defaults and applies INTELLINO_SPI_HZ, INTELLINO_SPI_MODE and INTELLINO_SPI_DELAY_US.
+struct Intellino_spi_config{
+    std::string device = "/dev/spidev0.0";  // or "emu" / "emu:<neurons>"
+    uint32_t speed_hz = 8000000;
+    uint8_t mode = 3;                        // SPI_MODE_3 (CPOL | CPHA)
+    uint8_t bits = 8;
+    uint16_t delay_usecs = 0;                // after each transfer segment
+};
+
+Intellino_spi_config intellino_spi_config(const char* device);
+
+// Linux spidev character device (e.g. /dev/spidev0.0)
+class Spidev_transport : public Intellino_transport{
+private:
+    int spi_fd = -1;
+    uint8_t mode;
+    uint8_t bits;
+    uint32_t speed;
+    uint16_t delay;
+    int bufsiz = 4096;                   // /sys/module/spidev/parameters/bufsiz
+    struct spi_ioc_transfer* segments = nullptr;
+    int segments_reserved = 0;
+    bool walks_winners = false;          // INTELLINO_CHIP_TOPK=1: the chip answers repeated reads with the next winner
+
+public:
+    static const int max_segment_len = 65532;  // per spi_ioc_transfer, below common controller DMA limits
+
+    Spidev_transport(const Intellino_spi_config& config);
+    ~Spidev_transport();
+    Spidev_transport(const Spidev_transport&) = delete;
+    Spidev_transport& operator=(const Spidev_transport&) = delete;
+    void transfer(char* tx, char* rx, int len);
+    void transfer_frames(char* tx, char* rx, int frame_len, int frames);
+    bool repeated_reads() const { return walks_winners; }
+    uint32_t speed_hz() const { return speed; }
+    bool set_speed_hz(uint32_t hz);
+};
+
+// "emu" or "emu:<neurons>" selects the software emulator, anything else is a spidev path.
+Intellino_transport* intellino_open_transport(const Intellino_spi_config& config);
+Intellino_transport* intellino_open_transport(const char* device);
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include "intellino_verifier.h"
+
+Intellino_verifier::Intellino_verifier(Intellino_classifier* chip, const Intellino_verify_policy& policy, int neuron_capacity)
+	: mirror(neuron_capacity) {
+	this->chip = chip;
+	this->policy = policy;
+	if (this->policy.sample_every < 0)
+		this->policy.sample_every = 0;
+	if (this->policy.max_retries < 0)
+		this->policy.max_retries = 0;
+}
+
+Intellino_verifier::~Intellino_verifier(){
+	stop_async();
+	delete chip;
+}
+
+// -------------------
+// learned state
+// -------------------
+void Intellino_verifier::remember (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	std::unique_lock<std::shared_mutex> lock(mirror_mutex);
+	int learned = mirror.size();
+	mirror.learn(vector_length, (const uint8_t*)learn_data, learn_category);
+	if (mirror.size() == learned)
+		return;     // past the chip's capacity, dropped there too
+	learned_categories[learn_category >> 6] |= 1ull << (learn_category & 63);
+	if (vector_length > longest_vector)
+		longest_vector = vector_length;
+}
+
+void Intellino_verifier::learn (int vector_length, const char* learn_data, uint8_t learn_category)
+{
+	chip->learn(vector_length, learn_data, learn_category);
+	remember(vector_length, learn_data, learn_category);
+}
+
+void Intellino_verifier::learn_multi (int multi_dataset_num, int vector_length,
+					const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category)
+{
+	chip->learn_multi(multi_dataset_num, vector_length, learn_multi_data, learn_multi_category);
+	for (int j=0; j<multi_dataset_num; j++)
+		remember(vector_length, learn_multi_data[j], learn_multi_category[j]);
+}
+
+// -------------------
+// checks
+// -------------------
+// rank r of a query exists only if more than r vectors are learned; past that the chip
+// answers 0xFFFF / category 0. mirror_mutex held by the caller.
+bool Intellino_verifier::plausible (int vector_length, int rank, int distance, int category) const
+{
+	if (rank >= mirror.size())
+		return distance == Intellino_knn::max_distance && category == 0;
+	int longest = vector_length > longest_vector ? vector_length : longest_vector;
+	if (distance < 0 || distance > 255*longest || category < 0 || category > 255)
+		return false;
+	return (learned_categories[category >> 6] >> (category & 63)) & 1;
+}
+
+// BRISK sets hold many duplicate rows (all-zero descriptors, for one), so a winning
+// distance is often shared; only scanned when a sampled category differs from the host's.
+bool Intellino_verifier::ties_at (int vector_length, const char* test_data, int distance, int category) const
+{
+	alignas(64) uint8_t query[vector_max_len] = {};
+	memcpy(query, test_data, vector_length < vector_max_len ? vector_length : vector_max_len);
+	for (int i=0; i<mirror.size(); i++) {
+		if (mirror.category(i) != category)
+			continue;
+		uint32_t d = intellino_l1_distance(query, mirror.row(i));
+		if ((d > (uint32_t)max_distance ? max_distance : (int)d) == distance)
+			return true;
+	}
+	return false;
+}
+
+bool Intellino_verifier::verify (long first, int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, const int *distance, const int *category)
+{
+	std::shared_lock<std::shared_mutex> lock(mirror_mutex);
+	for (int j=0; j<multi_dataset_num; j++) {
+		for (int r=0; r<k; r++) {
+			size_t i = (size_t)j*k + r;
+			if (!plausible(vector_length, r, distance[i], category[i]) || (r > 0 && distance[i] < distance[i-1])) {
+				implausible++;
+				return false;
+			}
+		}
+	}
+	if (policy.sample_every == 0)
+		return true;
+
+	std::vector<int> host_distance(k), host_category(k);
+	for (long j = (policy.sample_every - first % policy.sample_every) % policy.sample_every; j < multi_dataset_num; j += policy.sample_every) {
+		mirror.classify_topk(vector_length, (const uint8_t*)test_multi_data[j], k, host_distance.data(), host_category.data());
+		for (int r=0; r<k; r++) {
+			size_t i = (size_t)j*k + r;
+			bool same = distance[i] == host_distance[r] && (category[i] == host_category[r]
+					|| (r < mirror.size() && ties_at(vector_length, test_multi_data[j], distance[i], category[i])));
+			if (!same) {
+				mismatched++;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// k = 0 is a classify_multi, k >= 1 a classify_topk
+bool Intellino_verifier::classify_checked (long first, int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *distance, int *category)
+{
+	for (int attempt=0; ; attempt++) {
+		if (k == 0)
+			chip->classify_multi(multi_dataset_num, vector_length, test_multi_data, distance, category);
+		else
+			chip->classify_topk(multi_dataset_num, vector_length, test_multi_data, k, distance, category);
+		if (verify(first, multi_dataset_num, vector_length, test_multi_data, k ? k : 1, distance, category))
+			return true;
+		if (attempt == policy.max_retries)
+			return false;
+		retries++;
+	}
+}
+
+// -------------------
+// classify
+// -------------------
+void Intellino_verifier::classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category)
+{
+	const char (*row)[vector_max_len] = (const char (*)[vector_max_len])test_data;
+	long first = sampled++;
+	chip->classify(vector_length, test_data, classified_distance, classified_category);
+	for (int attempt=0; !verify(first, 1, vector_length, row, 1, classified_distance, classified_category); attempt++) {
+		if (attempt == policy.max_retries) {
+			fallbacks++;
+			std::shared_lock<std::shared_mutex> lock(mirror_mutex);
+			mirror.classify(vector_length, (const uint8_t*)test_data, classified_distance, classified_category);
+			break;
+		}
+		retries++;
+		chip->classify(vector_length, test_data, classified_distance, classified_category);
+	}
+	queries++;
+}
+
+void Intellino_verifier::classify_multi (int multi_dataset_num, int vector_length,
+					const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category)
+{
+	if (multi_dataset_num <= 0)
+		return;
+	long first = sampled.fetch_add(multi_dataset_num);
+	if (!classify_checked(first, multi_dataset_num, vector_length, test_multi_data, 0, classified_multi_distance, classified_multi_category)) {
+		fallbacks++;
+		std::shared_lock<std::shared_mutex> lock(mirror_mutex);
+		mirror.classify_multi(multi_dataset_num, vector_length, test_multi_data, classified_multi_distance, classified_multi_category);
+	}
+	queries += multi_dataset_num;
+}
+
+void Intellino_verifier::classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+					int k, int *classified_topk_distance, int *classified_topk_category)
+{
+	if (multi_dataset_num <= 0 || k <= 0)
+		return;
+	long first = sampled.fetch_add(multi_dataset_num);
+	if (!classify_checked(first, multi_dataset_num, vector_length, test_multi_data, k, classified_topk_distance, classified_topk_category)) {
+		fallbacks++;
+		std::shared_lock<std::shared_mutex> lock(mirror_mutex);
+		for (int j=0; j<multi_dataset_num; j++)
+			mirror.classify_topk(vector_length, (const uint8_t*)test_multi_data[j], k,
+					classified_topk_distance + (size_t)j*k, classified_topk_category + (size_t)j*k);
+	}
+	queries += multi_dataset_num;
+}
+
+// -------------------
+// stats
+// -------------------
+Intellino_verifier::Stats Intellino_verifier::stats () const
+{
+	return Stats{queries, implausible, mismatched, retries, fallbacks};
+}
+
+void Intellino_verifier::print_stats (FILE* fp) const
+{
+	Stats s = stats();
+	fprintf(fp, "verify: %ld queries, %ld implausible / %ld host-mismatched batches, %ld retries, %ld host fallbacks\n",
+		s.queries, s.implausible, s.mismatched, s.retries, s.fallbacks);
+}
@@ -0,0 +1,84 @@
+#ifndef INTELLINO_VERIFIER_H
+#define INTELLINO_VERIFIER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <shared_mutex>
+#include "intellino_classifier.h"
+#include "intellino_knn.h"
+
+// sample_every: the host recomputes one query in sample_every (0 = plausibility checks only)
+// max_retries: re-sends of a batch that failed a check before the host answers it instead
+struct Intellino_verify_policy{
+    int sample_every = 64;
+    int max_retries = 2;
+};
+
+// Checks every answer coming back from the chip, so bit errors on a fast bus turn into
+// retries instead of misclassifications. Each answer must be plausible: a learned
+// category, a distance no larger than 255 * the longest vector, top-k lists sorted,
+// and 0xFFFF / category 0 only past the learned count. Sampled queries are also
+// recomputed on a host copy of the learned vectors: every distance must match exactly,
+// every category must belong to a learned vector at that distance (ties may resolve
+// differently on the chip). A batch with any failure is sent again; after max_retries the
+// host copy answers it. Calls may run concurrently, classify_multi_async's included.
+class Intellino_verifier : public Intellino_classifier{
+private:
+    Intellino_classifier* chip;
+    Intellino_verify_policy policy;
+    Intellino_knn mirror;
+    uint64_t learned_categories[4] = {};
+    int longest_vector = 0;
+    mutable std::shared_mutex mirror_mutex;     // mirror, learned_categories, longest_vector
+    std::atomic<long> sampled{0};       // queries passed so far, picks the sampled ones
+
+    std::atomic<long> queries{0};
+    std::atomic<long> implausible{0};
+    std::atomic<long> mismatched{0};
+    std::atomic<long> retries{0};
+    std::atomic<long> fallbacks{0};
+
+    void remember (int vector_length, const char* learn_data, uint8_t learn_category);
+    bool plausible (int vector_length, int rank, int distance, int category) const;
+    // a learned vector at exactly distance from the query carries category
+    bool ties_at (int vector_length, const char* test_data, int distance, int category) const;
+    // first = sampled count before the batch, picks its sampled queries
+    bool verify (long first, int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, const int *distance, const int *category);
+    bool classify_checked (long first, int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *distance, int *category);
+
+public:
+    // takes ownership of chip; neuron_capacity must match the chip so the host copy drops
+    // the same overflow vectors (0 = unlimited)
+    Intellino_verifier(Intellino_classifier* chip, const Intellino_verify_policy& policy = Intellino_verify_policy(),
+                int neuron_capacity = 0);
+    ~Intellino_verifier();
+    Intellino_verifier(const Intellino_verifier&) = delete;
+    Intellino_verifier& operator=(const Intellino_verifier&) = delete;
+
+    void collect_metrics (Intellino_metrics& total) { chip->collect_metrics(total); }
+    void reset_metrics () { chip->reset_metrics(); }
+
+    void learn (int vector_length, const char* learn_data, uint8_t learn_category);
+    void learn_multi (int multi_dataset_num, int vector_length,
+                const char learn_multi_data[][vector_max_len], const uint8_t* learn_multi_category);
+    void classify (int vector_length, const char* test_data, int *classified_distance, int *classified_category);
+    void classify_multi (int multi_dataset_num, int vector_length,
+                const char test_multi_data[][vector_max_len], int *classified_multi_distance, int *classified_multi_category);
+    void classify_topk (int multi_dataset_num, int vector_length, const char test_multi_data[][vector_max_len],
+                int k, int *classified_topk_distance, int *classified_topk_category);
+
+    struct Stats{
+        long queries;
+        long implausible;       // batches with an impossible answer
+        long mismatched;        // batches where a sampled query disagreed with the host
+        long retries;
+        long fallbacks;         // batches answered by the host after max_retries
+    };
+    Stats stats () const;
+    void print_stats (FILE* fp) const;
+};
+
+#endif
@@ -1,213 +1,20 @@
 #include <stdint.h>
-#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <getopt.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/types.h>
-#include <linux/spi/spidev.h>
-#include <time.h>
-#include <stdarg.h>
-  
-#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))  
-  
-static void pabort(const char *s)  
-{  
-    perror(s);  
-    abort();  
-}  
-  
-static const char *device = "/dev/spidev0.0";  
-static uint8_t mode = SPI_CPHA | SPI_CPOL; //SPI_MODE3
-static uint8_t bits = 8;  
-static uint32_t speed = 8000000;   // max speed = 8000000
-static uint16_t delay = 0;
-clock_t sum_clock = 0;
+#include "intellino.h"
 
-static void transfer(int fd, char* tx, char* rx, int len)
-{  
-    int ret;
-    struct spi_ioc_transfer tr[] = {  
-        {
-            .tx_buf = (unsigned long)tx,  
-            .rx_buf = (unsigned long)rx,  
-            .len = len,  
-            .delay_usecs = delay,  
-            .speed_hz = speed,  
-            .bits_per_word = bits,  
-        }
-    };  
- 
-    clock_t start = clock();
-    ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-    sum_clock += clock() - start;
-    if (ret < 1)
-        pabort("can't send spi message");
-}
-
-// >>>>>>>>>> ================================================= //
-// ============= intellino PARAMETERS & FUNCTIONS ============= //
-// ============================================================ //
+// Stand-alone demo of the libintellino C interface (frames, spidev setup and batching
+// all come from the library): learns 30 vectors, classifies 50 in one batch and one
+// on its own. INTELLINO_DEVICE selects the device, e.g. INTELLINO_DEVICE=emu ./stu.out
 #define	VECTOR_LEN			64	// User define
-#define	LEARN_COMMAND			0x60
-#define	CLASSIFY_COMMAND		0x40
-#define	READ_DISTANCE			0x83
-#define	READ_CATEGORY			0x84
-#define	DUMMY				0x00
-
-// -------------------
-// intellino LEARN
-// -------------------
-static void intellino_learn (int fd, int vector_length, char* learn_data, uint8_t learn_category)
-{
-	char learn_tx_buf[vector_length+4];
-	char learn_rx_buf[vector_length+4];
-
-	for (int i=0; i<vector_length+3; i++) {
-		switch(i) {
-			case 0			:	learn_tx_buf[i] = LEARN_COMMAND;
-							break;
-			case 1			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) >> 8);
-							break;
-			case 2			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) & 0x00FF);
-							break;
-			default			:	learn_tx_buf[i] = learn_data[i-3];
-							break;
-		}
-	}
-	learn_tx_buf[vector_length+3] = learn_category;
-
-	transfer(fd, learn_tx_buf, learn_rx_buf, vector_length+4);
-}
-
-// -------------------
-// intellino CLASSIFY
-// -------------------
-static void intellino_classify (int fd, int vector_length, char* test_data, int *classified_distance, int *classified_category)
-{
-	char learn_tx_buf[vector_length+11];
-	char learn_rx_buf[vector_length+11];
-
-	for (int i=0; i<vector_length+3; i++) {
-		switch(i) {
-			case 0			:	learn_tx_buf[i] = CLASSIFY_COMMAND;
-							break;
-			case 1			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) >> 8);
-							break;
-			case 2			:	learn_tx_buf[i] = (uint8_t)((vector_length-1) & 0x00FF);
-							break;
-			default			:	learn_tx_buf[i] = test_data[i-3];
-							break;
-		}
-	}
-	learn_tx_buf[vector_length+3] = READ_DISTANCE;
-	learn_tx_buf[vector_length+4] = DUMMY;
-	learn_tx_buf[vector_length+5] = DUMMY;
-	learn_tx_buf[vector_length+6] = DUMMY;
-	learn_tx_buf[vector_length+7] = READ_CATEGORY;
-	learn_tx_buf[vector_length+8] = DUMMY;
-	learn_tx_buf[vector_length+9] = DUMMY;
-	learn_tx_buf[vector_length+10] = DUMMY;
-
-	transfer(fd, learn_tx_buf, learn_rx_buf, vector_length+11);
 
-	*classified_distance = (learn_rx_buf[vector_length+5]<<8) + learn_rx_buf[vector_length+6];
-	*classified_category = (learn_rx_buf[vector_length+9]<<8) + learn_rx_buf[vector_length+10];
-}
+char multi_array_gen ();
 
-// ------------------------
-// intellino CLASSIFY_MULTI
-// ------------------------
-static void intellino_classify_multi (int fd, int multi_dataset_num, char (*test_multi_data)[VECTOR_LEN], int *classified_multi_distance, int *classified_multi_category)
+int main()
 {
-	char learn_tx_buf[(VECTOR_LEN+11)*multi_dataset_num];
-	char learn_rx_buf[(VECTOR_LEN+11)*multi_dataset_num];
-
-	for (int j=0; j<multi_dataset_num; j++) {
-		for (int i=0; i<VECTOR_LEN+3; i++) {
-			switch(i) {
-				case 0			:	learn_tx_buf[(VECTOR_LEN+11)*j+i] = CLASSIFY_COMMAND;
-								break;
-				case 1			:	learn_tx_buf[(VECTOR_LEN+11)*j+i] = (uint8_t)((VECTOR_LEN-1) >> 8);
-								break;
-				case 2			:	learn_tx_buf[(VECTOR_LEN+11)*j+i] = (uint8_t)((VECTOR_LEN-1) & 0x00FF);
-								break;
-				default			:	learn_tx_buf[(VECTOR_LEN+11)*j+i] = test_multi_data[j][i-3];
-								break;
-			}
-		}
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+3)] = READ_DISTANCE;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+4)] = DUMMY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+5)] = DUMMY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+6)] = DUMMY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+7)] = READ_CATEGORY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+8)] = DUMMY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+9)] = DUMMY;
-		learn_tx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+10)] = DUMMY;
-	}
+    int ret = 0;
+    intellino_t* chip = intellino_create(NULL);
 
-	transfer(fd, learn_tx_buf, learn_rx_buf, (VECTOR_LEN+11)*multi_dataset_num);
-
-	for (int j=0; j<multi_dataset_num; j++) {
-		classified_multi_distance[j] = (learn_rx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+5)]<<8) + learn_rx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+6)];
-		classified_multi_category[j] = (learn_rx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+9)]<<8) + learn_rx_buf[(VECTOR_LEN+11)*j+(VECTOR_LEN+10)];
-	}
-}
-// ============================================================ //
-// ============= intellino PARAMETERS & FUNCTIONS ============= //
-// ================================================= <<<<<<<<<< //
-
-char multi_array_gen ();
-  
-  
-int main()
-{  
-    int ret = 0;  
-    int fd;  
-  
-  
-    fd = open(device, O_RDWR);  
-    if (fd < 0)  
-        pabort("can't open device");  
-  
-    /* 
-     * spi mode 
-     */  
-    ret = ioctl(fd, SPI_IOC_WR_MODE, &mode);  
-    if (ret == -1)  
-        pabort("can't set spi mode");  
-  
-    ret = ioctl(fd, SPI_IOC_RD_MODE, &mode);  
-    if (ret == -1)  
-        pabort("can't get spi mode");  
-  
-    /* 
-     * bits per word 
-     */  
-    ret = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits);  
-    if (ret == -1)  
-        pabort("can't set bits per word");  
-  
-    ret = ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits);  
-    if (ret == -1)  
-        pabort("can't get bits per word");  
-  
-    /* 
-     * max speed hz 
-     */  
-    ret = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);  
-    if (ret == -1)  
-        pabort("can't set max speed hz");  
-  
-    ret = ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);  
-    if (ret == -1)  
-        pabort("can't get max speed hz");  
-  
-    printf("spi mode: %d\n", mode);  
-    printf("bits per word: %d\n", bits);  
-    printf("max speed: %d Hz (%d KHz)\n", speed, speed/1000);  
- 
 // >>>>>--------------
 // Main operation
 // -------------------
@@ -356,41 +163,41 @@ int main()
 
 	// Learning
 	printf("Learning...\n");
-	intellino_learn(fd, vector_length, data_001, 1);
-	intellino_learn(fd, vector_length, data_002, 2);
-	intellino_learn(fd, vector_length, data_003, 3);
-	intellino_learn(fd, vector_length, data_004, 4);
-	intellino_learn(fd, vector_length, data_005, 5);
-	intellino_learn(fd, vector_length, data_006, 6);
-	intellino_learn(fd, vector_length, data_007, 7);
-	intellino_learn(fd, vector_length, data_008, 8);
-	intellino_learn(fd, vector_length, data_009, 9);
-	intellino_learn(fd, vector_length, data_010, 10);
-	intellino_learn(fd, vector_length, data_011, 11);
-	intellino_learn(fd, vector_length, data_012, 12);
-	intellino_learn(fd, vector_length, data_013, 13);
-	intellino_learn(fd, vector_length, data_014, 14);
-	intellino_learn(fd, vector_length, data_015, 15);
-	intellino_learn(fd, vector_length, data_016, 16);
-	intellino_learn(fd, vector_length, data_017, 17);
-	intellino_learn(fd, vector_length, data_018, 18);
-	intellino_learn(fd, vector_length, data_019, 19);
-	intellino_learn(fd, vector_length, data_020, 20);
-	intellino_learn(fd, vector_length, data_021, 21);
-	intellino_learn(fd, vector_length, data_022, 22);
-	intellino_learn(fd, vector_length, data_023, 23);
-	intellino_learn(fd, vector_length, data_024, 24);
-	intellino_learn(fd, vector_length, data_025, 25);
-	intellino_learn(fd, vector_length, data_026, 26);
-	intellino_learn(fd, vector_length, data_027, 27);
-	intellino_learn(fd, vector_length, data_028, 28);
-	intellino_learn(fd, vector_length, data_029, 29);
-	intellino_learn(fd, vector_length, data_030, 30);
+	intellino_learn(chip, vector_length, data_001, 1);
+	intellino_learn(chip, vector_length, data_002, 2);
+	intellino_learn(chip, vector_length, data_003, 3);
+	intellino_learn(chip, vector_length, data_004, 4);
+	intellino_learn(chip, vector_length, data_005, 5);
+	intellino_learn(chip, vector_length, data_006, 6);
+	intellino_learn(chip, vector_length, data_007, 7);
+	intellino_learn(chip, vector_length, data_008, 8);
+	intellino_learn(chip, vector_length, data_009, 9);
+	intellino_learn(chip, vector_length, data_010, 10);
+	intellino_learn(chip, vector_length, data_011, 11);
+	intellino_learn(chip, vector_length, data_012, 12);
+	intellino_learn(chip, vector_length, data_013, 13);
+	intellino_learn(chip, vector_length, data_014, 14);
+	intellino_learn(chip, vector_length, data_015, 15);
+	intellino_learn(chip, vector_length, data_016, 16);
+	intellino_learn(chip, vector_length, data_017, 17);
+	intellino_learn(chip, vector_length, data_018, 18);
+	intellino_learn(chip, vector_length, data_019, 19);
+	intellino_learn(chip, vector_length, data_020, 20);
+	intellino_learn(chip, vector_length, data_021, 21);
+	intellino_learn(chip, vector_length, data_022, 22);
+	intellino_learn(chip, vector_length, data_023, 23);
+	intellino_learn(chip, vector_length, data_024, 24);
+	intellino_learn(chip, vector_length, data_025, 25);
+	intellino_learn(chip, vector_length, data_026, 26);
+	intellino_learn(chip, vector_length, data_027, 27);
+	intellino_learn(chip, vector_length, data_028, 28);
+	intellino_learn(chip, vector_length, data_029, 29);
+	intellino_learn(chip, vector_length, data_030, 30);
 	printf("Done\n");
 
 	// Multi classification
 	printf("Multi Classification...\n");
-	intellino_classify_multi(fd, multi_dataset_num, classify_multi_data, dist_multi, cat_multi);
+	intellino_classify_multi(chip, multi_dataset_num, vector_length, (const char (*)[VECTOR_LEN])classify_multi_data, dist_multi, cat_multi);
 	for (int j=0; j<multi_dataset_num; j++) {
 		printf("data_%d -> DIST : %d / CAT : %d\n", (j+101), dist_multi[j], cat_multi[j]);
 	}
@@ -398,15 +205,15 @@ int main()
 
 	// Single classification
 	printf("Single Classification...\n");
-	intellino_classify(fd, vector_length, data_150, &dist, &cat);
+	intellino_classify(chip, vector_length, data_150, &dist, &cat);
 	printf("data_150 -> DIST : %d / CAT : %d\n", dist, cat);
 	printf("Done\n");
 
 
 
     puts("");
-    printf("spi transfer delay time (micro second) : %f\n", (double)sum_clock / CLOCKS_PER_SEC *1000 * 1000);
+    intellino_write_metrics(chip, stdout, INTELLINO_METRICS_JSON);
 
-    close(fd);
+    intellino_destroy(chip);
     return ret;  
 }